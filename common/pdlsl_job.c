@@ -0,0 +1,206 @@
+/*************** pdlsl_job *****************/
+/* Written by David Medine on behalf of    */
+/* Brain Products                          */
+/* 15/5/2017                               */
+/* Released under the GPL                  */
+/* This software is free and open source   */
+/*******************************************/
+
+
+#include "pdlsl_job.h"
+#include <stdio.h>
+
+#define WORKERS        4            // queries beyond this many wait for a free worker
+#define CACHE_TIMEOUT  2.0          // s the cached stream gets to answer before it is looked for
+#define RESOLVE_WAIT   5.0          // s a query listens for answers
+#define FULLINFO_WAIT  5.0          // s a stream gets to send its desc
+
+// the queue is the only thing the workers share, they are started as
+// jobs come in and stay around for the rest of the process
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static t_pdlsl_job *queue_head = NULL;
+static t_pdlsl_job *queue_tail = NULL;
+static int nworkers = 0;
+static int nidle = 0;
+
+// helper function declarations:
+static void *worker_thread(void *dummy);
+static void run_job(t_pdlsl_job *job);
+static int fetch_fullinfo(t_pdlsl_job *job);
+
+// the desc comes from the outlet itself, a throwaway inlet asks for it so
+// that the object's own inlet (and its listener) never waits on it
+static int fetch_fullinfo(t_pdlsl_job *job){
+
+  lsl_inlet in = lsl_create_inlet(job->info, 300, LSL_NO_PREFERENCE, 1);
+  lsl_streaminfo full;
+  int ec = lsl_no_error;
+
+  if(in==NULL)return 0;
+  full = lsl_get_fullinfo(in, FULLINFO_WAIT, &ec);
+  lsl_destroy_inlet(in);
+  if(ec!=lsl_no_error || full==NULL)return 0;
+  job->results[0] = full;
+  return 1;
+}
+
+// the only blocking calls, and they only touch the job
+static void run_job(t_pdlsl_job *job){
+
+  lsl_streaminfo info, full;
+  int cnt = 0, ec = lsl_no_error;
+
+  if(job->info!=NULL)cnt = fetch_fullinfo(job);
+  // the handshake tells whether the cached stream is still where it was
+  if(job->xml!=NULL && (info = lsl_streaminfo_from_xml(job->xml))!=NULL){
+    job->inlet = lsl_create_inlet(info, 300, LSL_NO_PREFERENCE, 1);
+    lsl_open_stream(job->inlet, CACHE_TIMEOUT, &ec);
+    if(ec==lsl_no_error){
+      // liblsl may have recovered it elsewhere, so the stream tells us who it is
+      full = lsl_get_fullinfo(job->inlet, CACHE_TIMEOUT, &ec);
+      if(ec==lsl_no_error && full!=NULL){
+	lsl_destroy_streaminfo(info);
+	info = full;
+      }
+      job->results[0] = info;
+      cnt = 1;
+    }
+    else{
+      lsl_destroy_inlet(job->inlet);
+      job->inlet = NULL;
+      // it moved or is gone: look for it by what outlives a restart
+      if(lsl_get_source_id(info)[0]!='\0')
+	snprintf(job->pred, MAXPDSTRING, "source_id='%s'", lsl_get_source_id(info));
+      else
+	snprintf(job->pred, MAXPDSTRING, "name='%s' and type='%s'", lsl_get_name(info), lsl_get_type(info));
+      lsl_destroy_streaminfo(info);
+    }
+  }
+  // one match is all a resolve needs, a listing waits the full timeout
+  if(cnt==0 && job->pred[0]!='\0')
+    cnt = lsl_resolve_bypred(job->results, PDLSL_JOB_RESULTS, job->pred, job->connect ? 1 : 0, RESOLVE_WAIT);
+  pthread_mutex_lock(&job->lock);
+  job->cnt = (cnt<0) ? 0 : (cnt>PDLSL_JOB_RESULTS ? PDLSL_JOB_RESULTS : cnt);
+  job->done = 1;
+  pthread_mutex_unlock(&job->lock);
+}
+
+static void *worker_thread(void *dummy){
+
+  t_pdlsl_job *job;
+
+  while(1){
+    pthread_mutex_lock(&queue_lock);
+    while(queue_head==NULL){
+      nidle++;
+      pthread_cond_wait(&queue_cond, &queue_lock);
+      nidle--;
+    }
+    job = queue_head;
+    queue_head = job->next;
+    if(queue_head==NULL)queue_tail = NULL;
+    pthread_mutex_unlock(&queue_lock);
+
+    run_job(job);
+    pdlsl_job_release(job);
+  }
+  return NULL;
+}
+
+t_pdlsl_job *pdlsl_job_new(void){
+
+  t_pdlsl_job *job = (t_pdlsl_job *)t_getbytes(sizeof(t_pdlsl_job));
+
+  job->pred[0] = '\0';
+  job->connect = 0;
+  job->xml = NULL;
+  job->xml_size = 0;
+  job->inlet = NULL;
+  job->info = NULL;
+  job->cnt = 0;
+  job->done = 0;
+  job->refs = 2;
+  job->next = NULL;
+  pthread_mutex_init(&job->lock, NULL);
+  return job;
+}
+
+int pdlsl_job_start(t_pdlsl_job *job, void *owner){
+
+  pthread_t tid;
+  int ok = 1;
+
+  if(!pdlsl_lib_load(owner)){
+    job->refs = 1;
+    pdlsl_job_release(job);
+    return 0;
+  }
+
+  pthread_mutex_lock(&queue_lock);
+  if(nidle==0 && nworkers<WORKERS){
+    if(pthread_create(&tid, NULL, worker_thread, NULL)==0){
+      pthread_detach(tid);
+      nworkers++;
+    }
+    // while any worker is running the job just waits a little longer
+    else if(nworkers==0)ok = 0;
+  }
+  if(ok){
+    if(queue_tail!=NULL)queue_tail->next = job;
+    else queue_head = job;
+    queue_tail = job;
+    pthread_cond_signal(&queue_cond);
+  }
+  pthread_mutex_unlock(&queue_lock);
+
+  if(!ok){
+    pd_error(owner, "pdlsl: error launching query thread");
+    job->refs = 1;
+    pdlsl_job_release(job);
+  }
+  return ok;
+}
+
+int pdlsl_job_done(t_pdlsl_job *job){
+
+  int done;
+
+  pthread_mutex_lock(&job->lock);
+  done = job->done;
+  pthread_mutex_unlock(&job->lock);
+  return done;
+}
+
+// the infos join the registry, so nobody has to ask the network for them again
+void pdlsl_job_collect(t_pdlsl_job *job, t_pdlsl_list *l){
+
+  int i;
+
+  pdlsl_list_clear(l);
+  for(i=0;i<job->cnt;i++)pdlsl_list_add(l, pdlsl_registry_add(job->results[i]));
+  job->cnt = 0;
+}
+
+lsl_streaminfo pdlsl_job_take(t_pdlsl_job *job){
+
+  if(job->cnt==0)return NULL;
+  job->cnt = 0;
+  return job->results[0];
+}
+
+void pdlsl_job_release(t_pdlsl_job *job){
+
+  int i, refs;
+
+  pthread_mutex_lock(&job->lock);
+  refs = --job->refs;
+  pthread_mutex_unlock(&job->lock);
+  if(refs>0)return;
+  for(i=0;i<job->cnt;i++)lsl_destroy_streaminfo(job->results[i]);
+  if(job->inlet!=NULL)lsl_destroy_inlet(job->inlet);
+  if(job->info!=NULL)lsl_destroy_streaminfo(job->info);
+  if(job->xml!=NULL)t_freebytes(job->xml, job->xml_size);
+  pthread_mutex_destroy(&job->lock);
+  t_freebytes(job, sizeof(t_pdlsl_job));
+}
@@ -0,0 +1,58 @@
+/*************** pdlsl_job *****************/
+/* Written by David Medine on behalf of    */
+/* Brain Products                          */
+/* 15/5/2017                               */
+/* Released under the GPL                  */
+/* This software is free and open source   */
+/*******************************************/
+
+// Queries that have to go out to the network (and the -cache handshake,
+// and the full info of a connected stream) block for seconds, so they run
+// on a small pool of workers shared by every object that links this in.
+// The workers never touch pd: the object polls its job from a clock and
+// picks the results up on pd's thread.
+
+#ifndef PDLSL_JOB_H
+#define PDLSL_JOB_H
+
+#include "m_pd.h"
+#include "pdlsl_lib.h"
+#include "pdlsl_registry.h"
+#include "pthread.h"
+
+#define PDLSL_JOB_RESULTS 1024       // room for a blocking resolve, far more than any lab runs
+
+// the query is copied in, so nothing of the message is touched after the
+// method returns, and the job belongs to the object and a worker together
+// until both have let go of it (the object may be deleted first).
+// a job with xml tries the cached stream first and only queries if that fails,
+// one with info only fetches that stream's full info (desc and all)
+typedef struct _pdlsl_job{
+  char               pred[MAXPDSTRING];     // the query compiled to XPath
+  int                connect;               // resolve_by_*: stop at the first match
+  char               *xml;                  // -cache: the stream from last time
+  int                xml_size;
+  lsl_inlet          inlet;                 // already open if the cached stream answered
+  lsl_streaminfo     info;                  // the connected stream, for its full info
+  lsl_streaminfo     results[PDLSL_JOB_RESULTS];
+  int                cnt;
+  int                done;
+  int                refs;
+  pthread_mutex_t    lock;
+  struct _pdlsl_job  *next;                 // in the workers' queue
+}t_pdlsl_job;
+
+// a job with both references taken, fill in pred (or xml) before starting it
+t_pdlsl_job *pdlsl_job_new(void);
+// loads liblsl and queues the job. returns 0 and lets go of both references
+// (complaining to owner) if it can't
+int pdlsl_job_start(t_pdlsl_job *job, void *owner);
+int pdlsl_job_done(t_pdlsl_job *job);
+// once done: the results join the registry and l, the job keeps none of them
+void pdlsl_job_collect(t_pdlsl_job *job, t_pdlsl_list *l);
+// once done: the full info of a job with info (NULL if the stream didn't
+// answer), which the caller has to destroy
+lsl_streaminfo pdlsl_job_take(t_pdlsl_job *job);
+void pdlsl_job_release(t_pdlsl_job *job);
+
+#endif
@@ -0,0 +1,206 @@
+/*************** pdlsl_lib *****************/
+/* Written by David Medine on behalf of    */
+/* Brain Products                          */
+/* 15/5/2017                               */
+/* Released under the GPL                  */
+/* This software is free and open source   */
+/*******************************************/
+
+
+// dladdr is an extension
+#define _GNU_SOURCE
+#define PDLSL_LIB_IMPL
+#include "m_pd.h"
+#include "pdlsl_lib.h"
+#include <string.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include "windows.h"
+typedef HMODULE t_libhandle;
+#ifdef _WIN64
+#define LIBLSL_NAME "liblsl64.dll"
+#else
+#define LIBLSL_NAME "liblsl32.dll"
+#endif
+#else
+#include <dlfcn.h>
+typedef void *t_libhandle;
+#if defined(__LP64__) || defined(_LP64)
+#define LIBLSL_NAME "liblsl64.so"
+#else
+#define LIBLSL_NAME "liblsl32.so"
+#endif
+#endif
+
+t_pdlsl_lib pdlsl_lib;
+
+static t_libhandle handle = NULL;
+
+// helper function declarations:
+static t_libhandle open_lib(char *path);
+static void close_lib(t_libhandle h);
+static void *find_symbol(t_libhandle h, char *name);
+static void lib_error(char *buf, int size);
+static int own_dir(char *buf, int size);
+
+static t_libhandle open_lib(char *path){
+
+#ifdef _WIN32
+  return LoadLibraryA(path);
+#else
+  return dlopen(path, RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+
+static void close_lib(t_libhandle h){
+
+#ifdef _WIN32
+  FreeLibrary(h);
+#else
+  dlclose(h);
+#endif
+}
+
+static void *find_symbol(t_libhandle h, char *name){
+
+#ifdef _WIN32
+  return (void *)GetProcAddress(h, name);
+#else
+  return dlsym(h, name);
+#endif
+}
+
+static void lib_error(char *buf, int size){
+
+#ifdef _WIN32
+  snprintf(buf, size, "error %lu", (unsigned long)GetLastError());
+#else
+  char *err = dlerror();
+  snprintf(buf, size, "%s", (err!=NULL) ? err : "unknown error");
+#endif
+}
+
+// the directory this external was loaded from, with a trailing separator.
+// liblsl shipped next to the external is found there before the system's
+static int own_dir(char *buf, int size){
+
+  char *sep;
+#ifdef _WIN32
+  HMODULE self;
+  if(!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+			 GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+			 (LPCSTR)&pdlsl_lib, &self))return 0;
+  if(GetModuleFileNameA(self, buf, size)==0)return 0;
+  sep = strrchr(buf, '\\');
+#else
+  Dl_info info;
+  if(dladdr((void *)&pdlsl_lib, &info)==0 || info.dli_fname==NULL)return 0;
+  snprintf(buf, size, "%s", info.dli_fname);
+  sep = strrchr(buf, '/');
+#endif
+  if(sep==NULL)return 0;
+  sep[1] = '\0';
+  return 1;
+}
+
+// a missing function means a liblsl too old for these externals, better
+// to refuse it than to crash on the first call that needs it
+#define LOAD(f) if((*(void **)&pdlsl_lib.f = find_symbol(h, "lsl_" #f))==NULL){missing = "lsl_" #f; goto fail;}
+
+int pdlsl_lib_load(void *owner){
+
+  char path[MAXPDSTRING], why[MAXPDSTRING];
+  char *missing = NULL;
+  t_libhandle h = NULL;
+
+  if(pdlsl_lib.loaded)return 1;
+
+  if(own_dir(path, MAXPDSTRING)){
+    strncat(path, LIBLSL_NAME, MAXPDSTRING - strlen(path) - 1);
+    h = open_lib(path);
+  }
+  if(h==NULL){
+    snprintf(path, MAXPDSTRING, "%s", LIBLSL_NAME);
+    h = open_lib(path);
+  }
+  if(h==NULL){
+    lib_error(why, MAXPDSTRING);
+    if(owner!=NULL)
+      pd_error(owner, "pdlsl: can't load %s (%s), it has to be next to the external or on the library path",
+	       LIBLSL_NAME, why);
+    else error("pdlsl: can't load %s (%s), it has to be next to the external or on the library path",
+	       LIBLSL_NAME, why);
+    return 0;
+  }
+
+  LOAD(append_child);
+  LOAD(append_child_value);
+  LOAD(child);
+  LOAD(child_value_n);
+  LOAD(copy_streaminfo);
+  LOAD(create_continuous_resolver);
+  LOAD(create_continuous_resolver_bypred);
+  LOAD(create_inlet);
+  LOAD(create_outlet);
+  LOAD(create_streaminfo);
+  LOAD(destroy_continuous_resolver);
+  LOAD(destroy_inlet);
+  LOAD(destroy_outlet);
+  LOAD(destroy_streaminfo);
+  LOAD(destroy_string);
+  LOAD(empty);
+  LOAD(get_channel_count);
+  LOAD(get_channel_format);
+  LOAD(get_desc);
+  LOAD(get_fullinfo);
+  LOAD(get_hostname);
+  LOAD(get_name);
+  LOAD(get_nominal_srate);
+  LOAD(get_source_id);
+  LOAD(get_type);
+  LOAD(get_uid);
+  LOAD(get_xml);
+  LOAD(have_consumers);
+  LOAD(local_clock);
+  LOAD(next_sibling_n);
+  LOAD(open_stream);
+  LOAD(pull_chunk_d);
+  LOAD(pull_chunk_str);
+  LOAD(pull_sample_d);
+  LOAD(pull_sample_f);
+  LOAD(pull_sample_i);
+  LOAD(pull_sample_s);
+  LOAD(pull_sample_str);
+  LOAD(push_chunk_ctn);
+  LOAD(push_chunk_dtn);
+  LOAD(push_chunk_ftn);
+  LOAD(push_chunk_ftp);
+  LOAD(push_chunk_itn);
+  LOAD(push_chunk_stn);
+  LOAD(push_chunk_stp);
+  LOAD(push_chunk_strtn);
+  LOAD(push_sample_ct);
+  LOAD(push_sample_dt);
+  LOAD(push_sample_ft);
+  LOAD(push_sample_it);
+  LOAD(push_sample_st);
+  LOAD(push_sample_strt);
+  LOAD(resolve_bypred);
+  LOAD(resolver_results);
+  LOAD(samples_available);
+  LOAD(streaminfo_from_xml);
+  LOAD(time_correction);
+  LOAD(was_clock_reset);
+
+  handle = h;
+  pdlsl_lib.loaded = 1;
+  return 1;
+
+ fail:
+  close_lib(h);
+  memset(&pdlsl_lib, 0, sizeof(t_pdlsl_lib));
+  if(owner!=NULL)pd_error(owner, "pdlsl: %s has no %s, it is too old for these externals", path, missing);
+  else error("pdlsl: %s has no %s, it is too old for these externals", path, missing);
+  return 0;
+}
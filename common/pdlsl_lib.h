@@ -0,0 +1,156 @@
+/*************** pdlsl_lib *****************/
+/* Written by David Medine on behalf of    */
+/* Brain Products                          */
+/* 15/5/2017                               */
+/* Released under the GPL                  */
+/* This software is free and open source   */
+/*******************************************/
+
+// liblsl is not linked, it is opened the first time an object really needs
+// it (to resolve, connect or create an outlet), so that merely loading a
+// patch with LSL objects in it doesn't start liblsl's threads and sockets.
+// Every lsl_ call used by the externals goes through the table below; the
+// defines at the end keep the call sites reading like the plain C API.
+
+#ifndef PDLSL_LIB_H
+#define PDLSL_LIB_H
+
+// only the types and prototypes are wanted, under Visual Studio lsl_c.h
+// would otherwise pull in the import library
+#ifndef LIBLSL_STATIC
+#define LIBLSL_STATIC
+#endif
+#include "lsl_c.h"
+
+typedef struct _pdlsl_lib{
+  int                     loaded;
+  lsl_xml_ptr             (*append_child)(lsl_xml_ptr e, char *name);
+  lsl_xml_ptr             (*append_child_value)(lsl_xml_ptr e, char *name, char *value);
+  lsl_xml_ptr             (*child)(lsl_xml_ptr e, char *name);
+  char *                  (*child_value_n)(lsl_xml_ptr e, char *name);
+  lsl_streaminfo          (*copy_streaminfo)(lsl_streaminfo info);
+  lsl_continuous_resolver (*create_continuous_resolver)(double forget_after);
+  lsl_continuous_resolver (*create_continuous_resolver_bypred)(char *pred, double forget_after);
+  lsl_inlet               (*create_inlet)(lsl_streaminfo info, int max_buflen, int max_chunklen, int recover);
+  lsl_outlet              (*create_outlet)(lsl_streaminfo info, int chunk_size, int max_buffered);
+  lsl_streaminfo          (*create_streaminfo)(char *name, char *type, int channel_count, double nominal_srate, lsl_channel_format_t channel_format, char *source_id);
+  void                    (*destroy_continuous_resolver)(lsl_continuous_resolver res);
+  void                    (*destroy_inlet)(lsl_inlet in);
+  void                    (*destroy_outlet)(lsl_outlet out);
+  void                    (*destroy_streaminfo)(lsl_streaminfo info);
+  void                    (*destroy_string)(char *s);
+  int                     (*empty)(lsl_xml_ptr e);
+  int                     (*get_channel_count)(lsl_streaminfo info);
+  lsl_channel_format_t    (*get_channel_format)(lsl_streaminfo info);
+  lsl_xml_ptr             (*get_desc)(lsl_streaminfo info);
+  lsl_streaminfo          (*get_fullinfo)(lsl_inlet in, double timeout, int *ec);
+  char *                  (*get_hostname)(lsl_streaminfo info);
+  char *                  (*get_name)(lsl_streaminfo info);
+  double                  (*get_nominal_srate)(lsl_streaminfo info);
+  char *                  (*get_source_id)(lsl_streaminfo info);
+  char *                  (*get_type)(lsl_streaminfo info);
+  char *                  (*get_uid)(lsl_streaminfo info);
+  char *                  (*get_xml)(lsl_streaminfo info);
+  int                     (*have_consumers)(lsl_outlet out);
+  double                  (*local_clock)(void);
+  lsl_xml_ptr             (*next_sibling_n)(lsl_xml_ptr e, char *name);
+  void                    (*open_stream)(lsl_inlet in, double timeout, int *ec);
+  unsigned long           (*pull_chunk_d)(lsl_inlet in, double *data_buffer, double *timestamp_buffer, unsigned long data_buffer_elements, unsigned long timestamp_buffer_elements, double timeout, int *ec);
+  unsigned long           (*pull_chunk_str)(lsl_inlet in, char **data_buffer, double *timestamp_buffer, unsigned long data_buffer_elements, unsigned long timestamp_buffer_elements, double timeout, int *ec);
+  double                  (*pull_sample_d)(lsl_inlet in, double *buffer, int buffer_elements, double timeout, int *ec);
+  double                  (*pull_sample_f)(lsl_inlet in, float *buffer, int buffer_elements, double timeout, int *ec);
+  double                  (*pull_sample_i)(lsl_inlet in, int *buffer, int buffer_elements, double timeout, int *ec);
+  double                  (*pull_sample_s)(lsl_inlet in, short *buffer, int buffer_elements, double timeout, int *ec);
+  double                  (*pull_sample_str)(lsl_inlet in, char **buffer, int buffer_elements, double timeout, int *ec);
+  int                     (*push_chunk_ctn)(lsl_outlet out, char *data, unsigned long data_elements, double *timestamps);
+  int                     (*push_chunk_dtn)(lsl_outlet out, double *data, unsigned long data_elements, double *timestamps);
+  int                     (*push_chunk_ftn)(lsl_outlet out, float *data, unsigned long data_elements, double *timestamps);
+  int                     (*push_chunk_ftp)(lsl_outlet out, float *data, unsigned long data_elements, double timestamp, int pushthrough);
+  int                     (*push_chunk_itn)(lsl_outlet out, int *data, unsigned long data_elements, double *timestamps);
+  int                     (*push_chunk_stn)(lsl_outlet out, short *data, unsigned long data_elements, double *timestamps);
+  int                     (*push_chunk_stp)(lsl_outlet out, short *data, unsigned long data_elements, double timestamp, int pushthrough);
+  int                     (*push_chunk_strtn)(lsl_outlet out, char **data, unsigned long data_elements, double *timestamps);
+  int                     (*push_sample_ct)(lsl_outlet out, char *data, double timestamp);
+  int                     (*push_sample_dt)(lsl_outlet out, double *data, double timestamp);
+  int                     (*push_sample_ft)(lsl_outlet out, float *data, double timestamp);
+  int                     (*push_sample_it)(lsl_outlet out, int *data, double timestamp);
+  int                     (*push_sample_st)(lsl_outlet out, short *data, double timestamp);
+  int                     (*push_sample_strt)(lsl_outlet out, char **data, double timestamp);
+  int                     (*resolve_bypred)(lsl_streaminfo *buffer, unsigned buffer_elements, char *pred, int minimum, double timeout);
+  int                     (*resolver_results)(lsl_continuous_resolver res, lsl_streaminfo *buffer, unsigned buffer_elements);
+  unsigned                (*samples_available)(lsl_inlet in);
+  lsl_streaminfo          (*streaminfo_from_xml)(char *xml);
+  double                  (*time_correction)(lsl_inlet in, double timeout, int *ec);
+  unsigned                (*was_clock_reset)(lsl_inlet in);
+}t_pdlsl_lib;
+
+extern t_pdlsl_lib pdlsl_lib;
+
+// opens liblsl unless that has happened already. returns 1 if the table can
+// be used, otherwise complains to owner (which may be NULL) and returns 0,
+// the next call tries again
+int pdlsl_lib_load(void *owner);
+#define pdlsl_lib_loaded() (pdlsl_lib.loaded)
+
+#ifndef PDLSL_LIB_IMPL
+#define lsl_append_child                         pdlsl_lib.append_child
+#define lsl_append_child_value                   pdlsl_lib.append_child_value
+#define lsl_child                                pdlsl_lib.child
+#define lsl_child_value_n                        pdlsl_lib.child_value_n
+#define lsl_copy_streaminfo                      pdlsl_lib.copy_streaminfo
+#define lsl_create_continuous_resolver           pdlsl_lib.create_continuous_resolver
+#define lsl_create_continuous_resolver_bypred    pdlsl_lib.create_continuous_resolver_bypred
+#define lsl_create_inlet                         pdlsl_lib.create_inlet
+#define lsl_create_outlet                        pdlsl_lib.create_outlet
+#define lsl_create_streaminfo                    pdlsl_lib.create_streaminfo
+#define lsl_destroy_continuous_resolver          pdlsl_lib.destroy_continuous_resolver
+#define lsl_destroy_inlet                        pdlsl_lib.destroy_inlet
+#define lsl_destroy_outlet                       pdlsl_lib.destroy_outlet
+#define lsl_destroy_streaminfo                   pdlsl_lib.destroy_streaminfo
+#define lsl_destroy_string                       pdlsl_lib.destroy_string
+#define lsl_empty                                pdlsl_lib.empty
+#define lsl_get_channel_count                    pdlsl_lib.get_channel_count
+#define lsl_get_channel_format                   pdlsl_lib.get_channel_format
+#define lsl_get_desc                             pdlsl_lib.get_desc
+#define lsl_get_fullinfo                         pdlsl_lib.get_fullinfo
+#define lsl_get_hostname                         pdlsl_lib.get_hostname
+#define lsl_get_name                             pdlsl_lib.get_name
+#define lsl_get_nominal_srate                    pdlsl_lib.get_nominal_srate
+#define lsl_get_source_id                        pdlsl_lib.get_source_id
+#define lsl_get_type                             pdlsl_lib.get_type
+#define lsl_get_uid                              pdlsl_lib.get_uid
+#define lsl_get_xml                              pdlsl_lib.get_xml
+#define lsl_have_consumers                       pdlsl_lib.have_consumers
+#define lsl_local_clock                          pdlsl_lib.local_clock
+#define lsl_next_sibling_n                       pdlsl_lib.next_sibling_n
+#define lsl_open_stream                          pdlsl_lib.open_stream
+#define lsl_pull_chunk_d                         pdlsl_lib.pull_chunk_d
+#define lsl_pull_chunk_str                       pdlsl_lib.pull_chunk_str
+#define lsl_pull_sample_d                        pdlsl_lib.pull_sample_d
+#define lsl_pull_sample_f                        pdlsl_lib.pull_sample_f
+#define lsl_pull_sample_i                        pdlsl_lib.pull_sample_i
+#define lsl_pull_sample_s                        pdlsl_lib.pull_sample_s
+#define lsl_pull_sample_str                      pdlsl_lib.pull_sample_str
+#define lsl_push_chunk_ctn                       pdlsl_lib.push_chunk_ctn
+#define lsl_push_chunk_dtn                       pdlsl_lib.push_chunk_dtn
+#define lsl_push_chunk_ftn                       pdlsl_lib.push_chunk_ftn
+#define lsl_push_chunk_ftp                       pdlsl_lib.push_chunk_ftp
+#define lsl_push_chunk_itn                       pdlsl_lib.push_chunk_itn
+#define lsl_push_chunk_stn                       pdlsl_lib.push_chunk_stn
+#define lsl_push_chunk_stp                       pdlsl_lib.push_chunk_stp
+#define lsl_push_chunk_strtn                     pdlsl_lib.push_chunk_strtn
+#define lsl_push_sample_ct                       pdlsl_lib.push_sample_ct
+#define lsl_push_sample_dt                       pdlsl_lib.push_sample_dt
+#define lsl_push_sample_ft                       pdlsl_lib.push_sample_ft
+#define lsl_push_sample_it                       pdlsl_lib.push_sample_it
+#define lsl_push_sample_st                       pdlsl_lib.push_sample_st
+#define lsl_push_sample_strt                     pdlsl_lib.push_sample_strt
+#define lsl_resolve_bypred                       pdlsl_lib.resolve_bypred
+#define lsl_resolver_results                     pdlsl_lib.resolver_results
+#define lsl_samples_available                    pdlsl_lib.samples_available
+#define lsl_streaminfo_from_xml                  pdlsl_lib.streaminfo_from_xml
+#define lsl_time_correction                      pdlsl_lib.time_correction
+#define lsl_was_clock_reset                      pdlsl_lib.was_clock_reset
+#endif
+
+#endif
@@ -0,0 +1,723 @@
+/************* pdlsl_registry **************/
+/* Written by David Medine on behalf of    */
+/* Brain Products                          */
+/* 15/5/2017                               */
+/* Released under the GPL                  */
+/* This software is free and open source   */
+/*******************************************/
+
+
+#include "pdlsl_registry.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define INIT_BUCKETS   64           // per index, doubled whenever the streams outnumber them twice
+#define INIT_RESULTS   64           // room for the resolver's results, doubled when it fills up
+#define POLL_INTERVAL  500          // ms between looks at the resolver's results
+#define FORGET_AFTER   5.0          // s before a silent stream drops out
+
+typedef struct _pdlsl_sub{
+  void            *owner;
+  t_pdlsl_notify  fn;
+}t_pdlsl_sub;
+
+typedef struct _pdlsl_registry{
+  int                      refs;
+  lsl_continuous_resolver  cr;
+  t_clock                  *clock;
+
+  t_pdlsl_entry            **bucket[PDLSL_NKEYS];
+  int                      nbuckets;
+  int                      count;
+  t_pdlsl_entry            *all;      // every entry, newest first
+
+  lsl_streaminfo           *results;  // scratch for lsl_resolver_results
+  int                      nresults;
+
+  t_pdlsl_sub              *subs;
+  int                      nsubs;
+}t_pdlsl_registry;
+
+static t_pdlsl_registry reg;
+
+struct _pdlsl_watch{
+  lsl_continuous_resolver  cr;
+  t_clock                  *clock;
+  void                     *owner;
+  t_pdlsl_notify           fn;
+  t_pdlsl_list             matches;   // what the last poll found
+  lsl_streaminfo           *results;
+  int                      nresults;
+};
+
+// as they are called in the stream info's XML, indexed by PDLSL_KEY_/PDLSL_FIELD_
+static char *field_names[PDLSL_NFIELDS] = {
+  "uid", "name", "type", "source_id",
+  "hostname", "channel_count", "nominal_srate", "channel_format"
+};
+
+// helper function declarations:
+static int key_hash(t_symbol *s, int nbuckets);
+static t_pdlsl_entry *new_entry(lsl_streaminfo info);
+static void release_entry(t_pdlsl_entry *e);
+static void link_entry(t_pdlsl_entry *e);
+static void unlink_entry(t_pdlsl_entry *e);
+static void grow_buckets(void);
+static t_pdlsl_entry *find_uid(t_symbol *uid);
+static void notify(t_symbol *event, t_pdlsl_entry *e);
+static void registry_poll(void *dummy);
+static int fetch_results(lsl_continuous_resolver cr, lsl_streaminfo **buf, int *size);
+static int field_from_flag(char *flag);
+static char *format_name(lsl_channel_format_t cft);
+static void watch_poll(t_pdlsl_watch *w);
+
+// the keys are symbols, so every value has exactly one pointer
+static int key_hash(t_symbol *s, int nbuckets){
+
+  return (int)(((size_t)s >> 3) % nbuckets);
+}
+
+static t_pdlsl_entry *new_entry(lsl_streaminfo info){
+
+  t_pdlsl_entry *e = (t_pdlsl_entry *)t_getbytes(sizeof(t_pdlsl_entry));
+
+  e->info = info;
+  e->key[PDLSL_KEY_UID] = gensym(lsl_get_uid(info));
+  e->key[PDLSL_KEY_NAME] = gensym(lsl_get_name(info));
+  e->key[PDLSL_KEY_TYPE] = gensym(lsl_get_type(info));
+  e->key[PDLSL_KEY_SOURCE_ID] = gensym(lsl_get_source_id(info));
+  e->refs = 1;
+  e->seen = 1;
+  e->resolved = 0;
+  e->added = clock_getlogicaltime();
+  return e;
+}
+
+static void release_entry(t_pdlsl_entry *e){
+
+  if(--e->refs > 0)return;
+  lsl_destroy_streaminfo(e->info);
+  t_freebytes(e, sizeof(t_pdlsl_entry));
+}
+
+static void link_entry(t_pdlsl_entry *e){
+
+  int k, h;
+
+  for(k=0;k<PDLSL_NKEYS;k++){
+    h = key_hash(e->key[k], reg.nbuckets);
+    e->next[k] = reg.bucket[k][h];
+    reg.bucket[k][h] = e;
+  }
+  e->next_all = reg.all;
+  reg.all = e;
+  if(++reg.count > 2 * reg.nbuckets)grow_buckets();
+}
+
+static void unlink_entry(t_pdlsl_entry *e){
+
+  t_pdlsl_entry **pp;
+  int k;
+
+  for(k=0;k<PDLSL_NKEYS;k++)
+    for(pp=&reg.bucket[k][key_hash(e->key[k], reg.nbuckets)];*pp!=NULL;pp=&(*pp)->next[k])
+      if(*pp==e){
+	*pp = e->next[k];
+	break;
+      }
+  for(pp=&reg.all;*pp!=NULL;pp=&(*pp)->next_all)
+    if(*pp==e){
+      *pp = e->next_all;
+      break;
+    }
+  reg.count--;
+}
+
+static void grow_buckets(void){
+
+  t_pdlsl_entry *e;
+  int k, h, nb = 2 * reg.nbuckets;
+
+  for(k=0;k<PDLSL_NKEYS;k++){
+    t_freebytes(reg.bucket[k], reg.nbuckets * sizeof(t_pdlsl_entry *));
+    reg.bucket[k] = (t_pdlsl_entry **)t_getbytes(nb * sizeof(t_pdlsl_entry *));
+  }
+  reg.nbuckets = nb;
+  for(e=reg.all;e!=NULL;e=e->next_all)
+    for(k=0;k<PDLSL_NKEYS;k++){
+      h = key_hash(e->key[k], nb);
+      e->next[k] = reg.bucket[k][h];
+      reg.bucket[k][h] = e;
+    }
+}
+
+static t_pdlsl_entry *find_uid(t_symbol *uid){
+
+  t_pdlsl_entry *e;
+
+  for(e=reg.bucket[PDLSL_KEY_UID][key_hash(uid, reg.nbuckets)];e!=NULL;e=e->next[PDLSL_KEY_UID])
+    if(e->key[PDLSL_KEY_UID]==uid)return e;
+  return NULL;
+}
+
+// a subscriber may let go of the registry (or subscribe another object)
+// from its callback, which reshuffles reg.subs or frees it. so the
+// subscribers are called from a copy, and only while they're still in
+static void notify(t_symbol *event, t_pdlsl_entry *e){
+
+  t_pdlsl_sub *subs;
+  int i, j, n = reg.nsubs;
+
+  if(n==0)return;
+  subs = (t_pdlsl_sub *)t_getbytes(n * sizeof(t_pdlsl_sub));
+  memcpy(subs, reg.subs, n * sizeof(t_pdlsl_sub));
+  for(i=0;i<n;i++){
+    for(j=0;j<reg.nsubs;j++)
+      if(reg.subs[j].owner==subs[i].owner)break;
+    if(j<reg.nsubs)(*subs[i].fn)(subs[i].owner, event, e);
+  }
+  t_freebytes(subs, n * sizeof(t_pdlsl_sub));
+}
+
+// the resolver's own thread does the network work, here we only copy its
+// results, so this is cheap enough for pd's thread
+static int fetch_results(lsl_continuous_resolver cr, lsl_streaminfo **buf, int *size){
+
+  int i, n;
+
+  for(;;){
+    n = lsl_resolver_results(cr, *buf, *size);
+    if(n < *size)return n;
+    // full, there may be more: start over with twice the room
+    for(i=0;i<n;i++)lsl_destroy_streaminfo((*buf)[i]);
+    *buf = (lsl_streaminfo *)t_resizebytes(*buf,
+					   *size * sizeof(lsl_streaminfo),
+					   2 * *size * sizeof(lsl_streaminfo));
+    *size *= 2;
+  }
+}
+
+// the registry is up to date before anybody hears about the changes
+static void registry_poll(void *dummy){
+
+  t_pdlsl_list appeared, gone;
+  t_pdlsl_entry *e, *next;
+  t_symbol *uid;
+  int i, n;
+
+  n = fetch_results(reg.cr, &reg.results, &reg.nresults);
+  if(n<0){
+    clock_delay(reg.clock, POLL_INTERVAL);
+    return;
+  }
+
+  pdlsl_list_init(&appeared);
+  pdlsl_list_init(&gone);
+  for(e=reg.all;e!=NULL;e=e->next_all)e->seen = 0;
+  for(i=0;i<n;i++){
+    uid = gensym(lsl_get_uid(reg.results[i]));
+    if((e = find_uid(uid))!=NULL){
+      e->seen = e->resolved = 1;
+      lsl_destroy_streaminfo(reg.results[i]);
+    }
+    else{
+      e = new_entry(reg.results[i]);
+      e->resolved = 1;
+      link_entry(e);
+      pdlsl_list_add(&appeared, e);
+    }
+  }
+  // streams added by a blocking resolve get the resolver's grace period
+  // before they count as gone for not being among its results
+  for(e=reg.all;e!=NULL;e=next){
+    next = e->next_all;
+    if(!e->seen && (e->resolved || clock_gettimesince(e->added) > FORGET_AFTER * 1000)){
+      unlink_entry(e);
+      pdlsl_list_add(&gone, e);
+      release_entry(e);
+    }
+  }
+
+  for(i=0;i<appeared.n;i++)notify(gensym("appeared"), appeared.v[i]);
+  for(i=0;i<gone.n;i++)notify(gensym("disappeared"), gone.v[i]);
+  pdlsl_list_free(&appeared);
+  pdlsl_list_free(&gone);
+
+  if(reg.refs>0)clock_delay(reg.clock, POLL_INTERVAL);
+}
+
+void pdlsl_registry_acquire(void *owner, t_pdlsl_notify fn){
+
+  int k;
+
+  if(reg.refs==0){
+    reg.nbuckets = INIT_BUCKETS;
+    for(k=0;k<PDLSL_NKEYS;k++)
+      reg.bucket[k] = (t_pdlsl_entry **)t_getbytes(reg.nbuckets * sizeof(t_pdlsl_entry *));
+    reg.count = 0;
+    reg.all = NULL;
+    reg.nresults = INIT_RESULTS;
+    reg.results = (lsl_streaminfo *)t_getbytes(reg.nresults * sizeof(lsl_streaminfo));
+    reg.subs = NULL;
+    reg.nsubs = 0;
+    reg.clock = clock_new(&reg, (t_method)registry_poll);
+    reg.cr = NULL;
+  }
+  reg.refs++;
+  if(fn!=NULL){
+    reg.subs = (t_pdlsl_sub *)t_resizebytes(reg.subs,
+					    reg.nsubs * sizeof(t_pdlsl_sub),
+					    (reg.nsubs+1) * sizeof(t_pdlsl_sub));
+    reg.subs[reg.nsubs].owner = owner;
+    reg.subs[reg.nsubs].fn = fn;
+    reg.nsubs++;
+  }
+}
+
+void pdlsl_registry_release(void *owner){
+
+  t_pdlsl_entry *e, *next;
+  int i, k;
+
+  for(i=0;i<reg.nsubs;i++)
+    if(reg.subs[i].owner==owner){
+      reg.subs[i] = reg.subs[reg.nsubs-1];
+      reg.subs = (t_pdlsl_sub *)t_resizebytes(reg.subs,
+					      reg.nsubs * sizeof(t_pdlsl_sub),
+					      (reg.nsubs-1) * sizeof(t_pdlsl_sub));
+      reg.nsubs--;
+      break;
+    }
+  if(reg.refs<=0 || --reg.refs > 0)return;
+
+  // lists still holding entries keep them alive on their own
+  clock_free(reg.clock);
+  if(reg.cr!=NULL)lsl_destroy_continuous_resolver(reg.cr);
+  for(e=reg.all;e!=NULL;e=next){
+    next = e->next_all;
+    release_entry(e);
+  }
+  reg.all = NULL;
+  reg.count = 0;
+  for(k=0;k<PDLSL_NKEYS;k++)
+    t_freebytes(reg.bucket[k], reg.nbuckets * sizeof(t_pdlsl_entry *));
+  t_freebytes(reg.results, reg.nresults * sizeof(lsl_streaminfo));
+  t_freebytes(reg.subs, reg.nsubs * sizeof(t_pdlsl_sub));
+  reg.subs = NULL;
+}
+
+// the resolver (and with it liblsl) only starts once somebody looks
+int pdlsl_registry_start(void *owner){
+
+  if(reg.refs==0)return 0;
+  if(reg.cr!=NULL)return 1;
+  if(!pdlsl_lib_load(owner))return 0;
+  reg.cr = lsl_create_continuous_resolver(FORGET_AFTER);
+  if(reg.cr==NULL){
+    error("pdlsl: unable to start the continuous resolver");
+    return 0;
+  }
+  clock_delay(reg.clock, POLL_INTERVAL);
+  return PDLSL_STARTED_NOW;
+}
+
+int pdlsl_registry_find(t_pdlsl_list *l, int key, t_symbol *value){
+
+  t_pdlsl_entry *e, *tmp;
+  int i, j, start = l->n;
+
+  if(!pdlsl_registry_start(NULL))return 0;
+  if(key<0){
+    for(e=reg.all;e!=NULL;e=e->next_all)
+      pdlsl_list_add(l, e);
+  }
+  else{
+    for(e=reg.bucket[key][key_hash(value, reg.nbuckets)];e!=NULL;e=e->next[key])
+      if(e->key[key]==value)pdlsl_list_add(l, e);
+  }
+  // the chains hold the newest first, listings read better the other way round
+  for(i=start, j=l->n-1;i<j;i++, j--){
+    tmp = l->v[i];
+    l->v[i] = l->v[j];
+    l->v[j] = tmp;
+  }
+  return l->n - start;
+}
+
+int pdlsl_registry_query(t_pdlsl_list *l, t_pdlsl_query *q){
+
+  t_pdlsl_entry *e, *tmp;
+  int i, j, key = -1, start = l->n;
+
+  if(!pdlsl_registry_start(NULL))return 0;
+  // one indexed condition narrows it down to a single chain
+  for(i=0;i<q->n;i++)
+    if(q->field[i] < PDLSL_NKEYS){
+      key = i;
+      break;
+    }
+  if(key<0){
+    for(e=reg.all;e!=NULL;e=e->next_all)
+      if(pdlsl_query_match(q, e->info))pdlsl_list_add(l, e);
+  }
+  else{
+    for(e=reg.bucket[q->field[key]][key_hash(q->value[key], reg.nbuckets)];e!=NULL;e=e->next[q->field[key]])
+      if(e->key[q->field[key]]==q->value[key] && pdlsl_query_match(q, e->info))
+	pdlsl_list_add(l, e);
+  }
+  for(i=start, j=l->n-1;i<j;i++, j--){
+    tmp = l->v[i];
+    l->v[i] = l->v[j];
+    l->v[j] = tmp;
+  }
+  return l->n - start;
+}
+
+t_pdlsl_entry *pdlsl_registry_add(lsl_streaminfo info){
+
+  t_pdlsl_entry *e = find_uid(gensym(lsl_get_uid(info)));
+
+  // whoever found info has liblsl open, and the resolver keeps e current
+  pdlsl_registry_start(NULL);
+  if(e!=NULL){
+    lsl_destroy_streaminfo(info);
+    return e;
+  }
+  e = new_entry(info);
+  link_entry(e);
+  notify(gensym("appeared"), e);
+  return e;
+}
+
+// queries:
+static int field_from_flag(char *flag){
+
+  int f;
+
+  if(flag[0]!='-')return -1;
+  for(f=0;f<PDLSL_NFIELDS;f++)
+    if(!strcmp(flag+1, field_names[f]))return f;
+  return -1;
+}
+
+static char *format_name(lsl_channel_format_t cft){
+
+  switch(cft){
+  case cft_float32: return "float32";
+  case cft_double64: return "double64";
+  case cft_string: return "string";
+  case cft_int32: return "int32";
+  case cft_int16: return "int16";
+  case cft_int8: return "int8";
+  case cft_int64: return "int64";
+  default: return "undefined";
+  }
+}
+
+int pdlsl_query_parse(t_pdlsl_query *q, void *owner, int argc, t_atom *argv){
+
+  char buf[MAXPDSTRING];
+  char cond[2*MAXPDSTRING];
+  char *flag;
+  int f, len = 0;
+
+  q->n = 0;
+  q->pred[0] = '\0';
+  while(argc > 0){
+    flag = atom_getsymbolarg(0, argc, argv)->s_name;
+    if((f = field_from_flag(flag))<0 || argc<2){
+      pd_error(owner, "%s: unknown field or value missing", flag);
+      return 0;
+    }
+    if(q->n==PDLSL_MAXCONDS){
+      pd_error(owner, "no more than %d conditions in one query", PDLSL_MAXCONDS);
+      return 0;
+    }
+    if(argv[1].a_type==A_SYMBOL)strncpy(buf, argv[1].a_w.w_symbol->s_name, MAXPDSTRING-1);
+    else atom_string(argv+1, buf, MAXPDSTRING);
+    buf[MAXPDSTRING-1] = '\0';
+    if(f==PDLSL_FIELD_CHANNEL_FORMAT && !strncmp(buf, "cft_", 4))
+      memmove(buf, buf+4, strlen(buf+4)+1);
+
+    // numbers go in bare, everything else as a string literal
+    if(f==PDLSL_FIELD_CHANNEL_COUNT || f==PDLSL_FIELD_NOMINAL_SRATE)
+      snprintf(cond, sizeof(cond), "%s%s=%s", q->n ? " and " : "", field_names[f], buf);
+    else if(strchr(buf, '\'')!=NULL)
+      snprintf(cond, sizeof(cond), "%s%s=\"%s\"", q->n ? " and " : "", field_names[f], buf);
+    else
+      snprintf(cond, sizeof(cond), "%s%s='%s'", q->n ? " and " : "", field_names[f], buf);
+    if(len + strlen(cond) >= MAXPDSTRING){
+      pd_error(owner, "query too long");
+      return 0;
+    }
+    strcpy(q->pred + len, cond);
+    len += strlen(cond);
+
+    q->field[q->n] = f;
+    q->value[q->n] = gensym(buf);
+    q->n++;
+    argc-=2, argv+=2;
+  }
+  if(q->n==0){
+    pd_error(owner, "empty query");
+    return 0;
+  }
+  return 1;
+}
+
+int pdlsl_query_match(t_pdlsl_query *q, lsl_streaminfo info){
+
+  char *v;
+  int i;
+
+  for(i=0;i<q->n;i++){
+    v = q->value[i]->s_name;
+    switch(q->field[i]){
+    case PDLSL_KEY_UID: if(strcmp(lsl_get_uid(info), v))return 0; break;
+    case PDLSL_KEY_NAME: if(strcmp(lsl_get_name(info), v))return 0; break;
+    case PDLSL_KEY_TYPE: if(strcmp(lsl_get_type(info), v))return 0; break;
+    case PDLSL_KEY_SOURCE_ID: if(strcmp(lsl_get_source_id(info), v))return 0; break;
+    case PDLSL_FIELD_HOSTNAME: if(strcmp(lsl_get_hostname(info), v))return 0; break;
+    case PDLSL_FIELD_CHANNEL_COUNT: if(lsl_get_channel_count(info) != atof(v))return 0; break;
+    case PDLSL_FIELD_NOMINAL_SRATE: if(lsl_get_nominal_srate(info) != atof(v))return 0; break;
+    case PDLSL_FIELD_CHANNEL_FORMAT: if(strcmp(format_name(lsl_get_channel_format(info)), v))return 0; break;
+    default: return 0;
+    }
+  }
+  return 1;
+}
+
+// watches:
+static void watch_poll(t_pdlsl_watch *w){
+
+  t_pdlsl_list old;
+  int i, j, n;
+
+  n = fetch_results(w->cr, &w->results, &w->nresults);
+  if(n>=0){
+    old = w->matches;
+    pdlsl_list_init(&w->matches);
+    for(i=0;i<n;i++)pdlsl_list_add(&w->matches, pdlsl_registry_add(w->results[i]));
+    // the entries are unique, so comparing pointers is enough
+    for(i=0;i<w->matches.n;i++){
+      for(j=0;j<old.n && old.v[j]!=w->matches.v[i];j++);
+      if(j==old.n)(*w->fn)(w->owner, gensym("matched"), w->matches.v[i]);
+    }
+    for(j=0;j<old.n;j++){
+      for(i=0;i<w->matches.n && w->matches.v[i]!=old.v[j];i++);
+      if(i==w->matches.n)(*w->fn)(w->owner, gensym("unmatched"), old.v[j]);
+    }
+    pdlsl_list_free(&old);
+  }
+  clock_delay(w->clock, POLL_INTERVAL);
+}
+
+t_pdlsl_watch *pdlsl_watch_new(char *pred, void *owner, t_pdlsl_notify fn){
+
+  t_pdlsl_watch *w;
+  lsl_continuous_resolver cr;
+
+  if(!pdlsl_lib_load(owner))return NULL;
+  cr = lsl_create_continuous_resolver_bypred(pred, FORGET_AFTER);
+  if(cr==NULL)return NULL;
+  w = (t_pdlsl_watch *)t_getbytes(sizeof(t_pdlsl_watch));
+  w->cr = cr;
+  w->owner = owner;
+  w->fn = fn;
+  pdlsl_list_init(&w->matches);
+  w->nresults = INIT_RESULTS;
+  w->results = (lsl_streaminfo *)t_getbytes(w->nresults * sizeof(lsl_streaminfo));
+  w->clock = clock_new(w, (t_method)watch_poll);
+  clock_delay(w->clock, POLL_INTERVAL);
+  return w;
+}
+
+void pdlsl_watch_free(t_pdlsl_watch *w){
+
+  clock_free(w->clock);
+  lsl_destroy_continuous_resolver(w->cr);
+  pdlsl_list_free(&w->matches);
+  t_freebytes(w->results, w->nresults * sizeof(lsl_streaminfo));
+  t_freebytes(w, sizeof(t_pdlsl_watch));
+}
+
+// lists:
+void pdlsl_list_init(t_pdlsl_list *l){
+
+  l->v = NULL;
+  l->n = 0;
+  l->size = 0;
+}
+
+void pdlsl_list_add(t_pdlsl_list *l, t_pdlsl_entry *e){
+
+  int size;
+
+  if(l->n == l->size){
+    size = l->size ? 2 * l->size : 16;
+    l->v = (t_pdlsl_entry **)t_resizebytes(l->v,
+					   l->size * sizeof(t_pdlsl_entry *),
+					   size * sizeof(t_pdlsl_entry *));
+    l->size = size;
+  }
+  e->refs++;
+  l->v[l->n++] = e;
+}
+
+void pdlsl_list_clear(t_pdlsl_list *l){
+
+  int i;
+
+  for(i=0;i<l->n;i++)release_entry(l->v[i]);
+  l->n = 0;
+}
+
+void pdlsl_list_free(t_pdlsl_list *l){
+
+  pdlsl_list_clear(l);
+  if(l->v!=NULL)t_freebytes(l->v, l->size * sizeof(t_pdlsl_entry *));
+  pdlsl_list_init(l);
+}
+
+void pdlsl_list_post(t_pdlsl_list *l){
+
+  int i;
+
+  post("----------available lsl streams------------");
+  for(i=0;i<l->n;i++)
+    post("[%d] name: %s  |  type: %s  |  source_id: %s",
+	 i,
+	 lsl_get_name(pdlsl_list_info(l, i)),
+	 lsl_get_type(pdlsl_list_info(l, i)),
+	 lsl_get_source_id(pdlsl_list_info(l, i)));
+}
+
+// the on-disk cache:
+t_symbol *pdlsl_cache_path(char *key){
+
+  char path[MAXPDSTRING];
+
+  snprintf(path, MAXPDSTRING, "%s/pdlsl-%s.xml", canvas_getcurrentdir()->s_name, key);
+  return gensym(path);
+}
+
+char *pdlsl_cache_read(t_symbol *path, int *size){
+
+  FILE *fp = sys_fopen(path->s_name, "rb");
+  char *xml;
+  long len;
+
+  if(fp==NULL)return NULL;
+  fseek(fp, 0, SEEK_END);
+  len = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  if(len<=0){
+    sys_fclose(fp);
+    return NULL;
+  }
+  *size = (int)len + 1;
+  xml = (char *)t_getbytes(*size);
+  if(fread(xml, 1, len, fp)!=(size_t)len){
+    t_freebytes(xml, *size);
+    sys_fclose(fp);
+    return NULL;
+  }
+  xml[len] = '\0';
+  sys_fclose(fp);
+  return xml;
+}
+
+void pdlsl_cache_write(t_symbol *path, lsl_streaminfo info){
+
+  FILE *fp = sys_fopen(path->s_name, "wb");
+  char *xml;
+
+  if(fp==NULL){
+    post("pdlsl: could not write %s", path->s_name);
+    return;
+  }
+  xml = lsl_get_xml(info);
+  fputs(xml, fp);
+  lsl_destroy_string(xml);
+  sys_fclose(fp);
+}
+
+// channel tables:
+void pdlsl_channels_init(t_pdlsl_channels *c){
+
+  c->n = 0;
+  c->nlabels = 0;
+  c->label = NULL;
+  c->unit = NULL;
+  c->scale = NULL;
+  c->offset = NULL;
+}
+
+int pdlsl_channels_described(lsl_streaminfo info){
+
+  return !lsl_empty(lsl_child(lsl_child(lsl_get_desc(info), "channels"), "channel"));
+}
+
+int pdlsl_channels_parse(t_pdlsl_channels *c, lsl_streaminfo info, int n){
+
+  lsl_xml_ptr chn;
+  char *val;
+  int i;
+
+  pdlsl_channels_free(c);
+  c->n = n;
+  c->label = (t_symbol **)t_getbytes(n * sizeof(t_symbol *));
+  c->unit = (t_symbol **)t_getbytes(n * sizeof(t_symbol *));
+  c->scale = (t_float *)t_getbytes(n * sizeof(t_float));
+  c->offset = (t_float *)t_getbytes(n * sizeof(t_float));
+  for(i=0;i<n;i++){
+    c->label[i] = c->unit[i] = &s_;
+    c->scale[i] = 1;
+    c->offset[i] = 0;
+  }
+  if(info==NULL)return 0;
+
+  chn = lsl_child(lsl_child(lsl_get_desc(info), "channels"), "channel");
+  for(i=0;i<n && !lsl_empty(chn);i++){
+    val = lsl_child_value_n(chn, "label");
+    if(val[0]!='\0'){
+      c->label[i] = gensym(val);
+      c->nlabels++;
+    }
+    val = lsl_child_value_n(chn, "unit");
+    if(val[0]!='\0')c->unit[i] = gensym(val);
+    val = lsl_child_value_n(chn, "scale");
+    if(val[0]!='\0')c->scale[i] = atof(val);
+    val = lsl_child_value_n(chn, "offset");
+    if(val[0]!='\0')c->offset[i] = atof(val);
+    chn = lsl_next_sibling_n(chn, "channel");
+  }
+  return c->nlabels;
+}
+
+void pdlsl_channels_free(t_pdlsl_channels *c){
+
+  if(c->n!=0){
+    t_freebytes(c->label, c->n * sizeof(t_symbol *));
+    t_freebytes(c->unit, c->n * sizeof(t_symbol *));
+    t_freebytes(c->scale, c->n * sizeof(t_float));
+    t_freebytes(c->offset, c->n * sizeof(t_float));
+  }
+  pdlsl_channels_init(c);
+}
+
+// labels are symbols, so this is a pointer comparison per channel
+int pdlsl_channels_find(t_pdlsl_channels *c, t_atom *a){
+
+  int i;
+
+  if(a->a_type==A_FLOAT){
+    i = (int)atom_getfloat(a);
+    return (i>=0 && i<c->n) ? i : -1;
+  }
+  if(a->a_type!=A_SYMBOL || a->a_w.w_symbol==&s_)return -1;
+  for(i=0;i<c->n;i++)
+    if(c->label[i]==a->a_w.w_symbol)return i;
+  return -1;
+}
@@ -0,0 +1,139 @@
+/************* pdlsl_registry **************/
+/* Written by David Medine on behalf of    */
+/* Brain Products                          */
+/* 15/5/2017                               */
+/* Released under the GPL                  */
+/* This software is free and open source   */
+/*******************************************/
+
+// One directory of the LSL streams on the network, shared by every object
+// that links it in. A single continuous resolver feeds it from a pd clock
+// and each stream is indexed by uid, name, type and source_id. Everything
+// here runs on pd's thread, so nothing is locked.
+
+#ifndef PDLSL_REGISTRY_H
+#define PDLSL_REGISTRY_H
+
+#include "m_pd.h"
+#include "pdlsl_lib.h"
+
+// the properties a stream can be looked up by
+#define PDLSL_KEY_UID       0
+#define PDLSL_KEY_NAME      1
+#define PDLSL_KEY_TYPE      2
+#define PDLSL_KEY_SOURCE_ID 3
+#define PDLSL_NKEYS         4
+
+// further fields a query can test, they are not indexed
+#define PDLSL_FIELD_HOSTNAME       4
+#define PDLSL_FIELD_CHANNEL_COUNT  5
+#define PDLSL_FIELD_NOMINAL_SRATE  6
+#define PDLSL_FIELD_CHANNEL_FORMAT 7
+#define PDLSL_NFIELDS              8
+#define PDLSL_MAXCONDS             16
+
+typedef struct _pdlsl_entry{
+  lsl_streaminfo         info;
+  t_symbol               *key[PDLSL_NKEYS];
+  int                    refs;                // the registry's own plus one per list holding it
+  int                    seen;                // among the resolver's latest results
+  int                    resolved;            // the resolver has reported it at all
+  double                 added;               // logical time it joined the registry
+  struct _pdlsl_entry    *next[PDLSL_NKEYS];  // chain in each index
+  struct _pdlsl_entry    *next_all;
+}t_pdlsl_entry;
+
+// a list of entries that keeps them (and their infos) alive until cleared,
+// so an object's numbered listing stays valid while the registry moves on
+typedef struct _pdlsl_list{
+  t_pdlsl_entry  **v;
+  int            n;
+  int            size;
+}t_pdlsl_list;
+
+// a compound query: every condition has to hold. it is checked against the
+// registry directly and compiled to an XPath predicate for the network
+typedef struct _pdlsl_query{
+  int            n;
+  int            field[PDLSL_MAXCONDS];
+  t_symbol       *value[PDLSL_MAXCONDS];
+  char           pred[MAXPDSTRING];
+}t_pdlsl_query;
+
+// called with "appeared" or "disappeared" once the registry is up to date again
+typedef void (*t_pdlsl_notify)(void *owner, t_symbol *event, t_pdlsl_entry *e);
+
+// every user holds a reference, the last one stops the resolver and
+// frees the registry
+void pdlsl_registry_acquire(void *owner, t_pdlsl_notify fn);
+void pdlsl_registry_release(void *owner);
+// nothing is resolved (and liblsl isn't even loaded) until the first
+// lookup or this call. returns 0 and complains to owner if liblsl is missing,
+// PDLSL_STARTED_NOW if the resolver has only just been started (and can't
+// know of any streams yet) and 1 if it was already running
+#define PDLSL_STARTED_NOW 2
+int pdlsl_registry_start(void *owner);
+
+// appends every stream (key < 0) or those whose key matches value
+// returns the number appended
+int pdlsl_registry_find(t_pdlsl_list *l, int key, t_symbol *value);
+
+// streams found some other way (a blocking resolve) join the registry.
+// takes over info, returns the entry it ended up in (perhaps an existing one)
+t_pdlsl_entry *pdlsl_registry_add(lsl_streaminfo info);
+
+// appends the streams that satisfy every condition of q, returns the number appended
+int pdlsl_registry_query(t_pdlsl_list *l, t_pdlsl_query *q);
+
+// -<field> <value> pairs (-name -type -source_id -uid -hostname -channel_count
+// -nominal_srate -channel_format), returns 0 and complains to owner if it can't
+int pdlsl_query_parse(t_pdlsl_query *q, void *owner, int argc, t_atom *argv);
+int pdlsl_query_match(t_pdlsl_query *q, lsl_streaminfo info);
+
+// a continuous resolver of its own that only ever transfers the streams
+// matching a predicate. they join the registry and fn hears "matched" and
+// "unmatched" as the set changes
+typedef struct _pdlsl_watch t_pdlsl_watch;
+t_pdlsl_watch *pdlsl_watch_new(char *pred, void *owner, t_pdlsl_notify fn);
+void pdlsl_watch_free(t_pdlsl_watch *w);
+
+// the last stream an object was connected to, kept next to its patch as
+// pdlsl-<key>.xml so that the next load can connect without resolving.
+// pdlsl_cache_path only works while the object is being created
+t_symbol *pdlsl_cache_path(char *key);
+// returns the XML (size bytes from t_getbytes) or NULL if there is none
+char *pdlsl_cache_read(t_symbol *path, int *size);
+void pdlsl_cache_write(t_symbol *path, lsl_streaminfo info);
+
+// what the stream's desc says about its channels, in the layout of the XDF
+// meta-data (<channels><channel><label/><unit/><type/>...), plus the
+// <scale/> and <offset/> that lsl_outlet~ writes for int16 streams.
+// only full infos (lsl_get_fullinfo) carry a desc, so it is parsed once
+// per connection when a worker has fetched one
+typedef struct _pdlsl_channels{
+  int            n;
+  int            nlabels;           // how many channels have a label at all
+  t_symbol       **label;           // &s_ where there is none
+  t_symbol       **unit;
+  t_float        *scale;            // 1 and 0 where there is none
+  t_float        *offset;
+}t_pdlsl_channels;
+
+void pdlsl_channels_init(t_pdlsl_channels *c);
+// n channels described by info (NULL for none of them), returns nlabels
+int pdlsl_channels_parse(t_pdlsl_channels *c, lsl_streaminfo info, int n);
+void pdlsl_channels_free(t_pdlsl_channels *c);
+// a label or a channel number, -1 if there is no such channel
+int pdlsl_channels_find(t_pdlsl_channels *c, t_atom *a);
+// 1 if info has a desc to parse, so there is nothing to fetch
+int pdlsl_channels_described(lsl_streaminfo info);
+
+void pdlsl_list_init(t_pdlsl_list *l);
+void pdlsl_list_add(t_pdlsl_list *l, t_pdlsl_entry *e);
+void pdlsl_list_clear(t_pdlsl_list *l);
+void pdlsl_list_free(t_pdlsl_list *l);
+// the numbered listing the connect_by_idx methods refer to
+void pdlsl_list_post(t_pdlsl_list *l);
+#define pdlsl_list_info(l, i) ((l)->v[(i)]->info)
+
+#endif
@@ -8,7 +8,9 @@
 
 
 #include "m_pd.h"
-#include "lsl_c.h"
+#include "pdlsl_lib.h"
+#include "pdlsl_registry.h"
+#include "pdlsl_job.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -16,10 +18,40 @@
 
 #ifdef _WIN32
 #include "windows.h"
+#define memory_barrier() MemoryBarrier()
 #else
 #include <unistd.h>
+#define memory_barrier() __sync_synchronize()
 #endif
 
+// delivery modes for streams with a nominal sampling rate
+#define MODE_LATEST 0                // output the most recent sample
+#define MODE_MEAN   1                // output the average of everything since the last output
+
+// what to do with markers that pile up upstream before we get to them
+// (on connect, or when liblsl recovers a lost connection)
+#define BACKLOG_ALL    0             // deliver everything
+#define BACKLOG_MAXAGE 1             // drop markers older than backlog_maxage ms
+#define BACKLOG_NEWEST 2             // keep only the newest backlog_newest markers
+#define REPLAY_AGE     1.0           // s, a burst older than this piled up while the connection was down
+#define TC_WAIT        2.0           // s the listener waits for a time correction estimate in all
+
+// signal outlet modes for sample accurate triggers
+#define TRIGGER_OFF     0
+#define TRIGGER_IMPULSE 1            // one sample impulse carrying the marker value
+#define TRIGGER_STEP    2            // hold the marker value until the next one
+#define TRIGGER_RINGLEN 256          // must be a power of 2
+
+// the stream directory is the registry shared with every other object and
+// queries run on the workers of pdlsl_job (common/)
+#define JOB_POLL        50           // ms between checks on a query running on a worker
+#define SYNC_INTERVAL   50           // ms between refinements of the clock mapping for -trigger
+
+typedef struct _trigger_event{
+  double     t;                     // local lsl time of the marker
+  t_sample   val;                   // first channel for numeric streams, 1 for strings
+}t_trigger_event;
+
 // pd boilerplate:
 static t_class *lsl_inlet_class;
 
@@ -27,21 +59,85 @@ typedef struct _lsl_inlet{
 
   t_object    x_obj;
 
-  // lsl message buffers
-  char*      str_marker;            // only two types allowed (only ones that make sense in Pd)
-  float      f_marker;
+  // lsl message buffers (sized to the channel count of the stream on connect)
+  int        nchannels;             // number of channels in the connected stream
+  t_atom     *out_atoms;            // preallocated list that each sample is written into for output
+
+  // channels Cz Pz Oz: the channels that come out, and in which order
+  t_atom     *sel;                  // as asked for, labels and/or channel numbers
+  int        nsel;                  // 0 for all of them
+  int        *sel_idx;              // resolved against the stream, -1 where there is no such channel
+  int        sel_ready;             // 0 while labels wait for the stream's desc
+  t_atom     *sel_atoms;            // preallocated list for the selected channels
+
+  // queue of pulled samples waiting to be output on pd's thread
+  char       **str_queue;           // qlen * nchannels string pointers (owned by liblsl until output)
+  double     *d_queue;              // qlen * nchannels numeric values
+  double     *ts_queue;             // qlen timestamps
+  int        qlen;                  // capacity of the queue in samples
+  int        q_widx;                // write index (listener thread)
+  int        q_ridx;                // read index (pd thread)
+  int        q_cnt;                 // number of samples waiting
+  int        q_dropped;             // samples dropped because the queue was full
+  t_clock    *poll_clock;           // drains the queue on pd's thread
+  double     poll_interval;         // in ms
+
+  // control rate delivery of regular (nominal rate != 0) streams
+  int        regular;               // flag to say the connected stream has a nominal rate
+  int        mode;                  // MODE_LATEST or MODE_MEAN
+  double     interval;              // output period in ms for regular streams
+
+  // scratch space for the listener (both kinds of streams)
+  int        chunklen;              // samples per background chunk pull
+
+  // backlog policy
+  int        backlog;               // BACKLOG_ALL, BACKLOG_MAXAGE or BACKLOG_NEWEST
+  double     backlog_maxage;        // in ms
+  int        backlog_newest;        // in samples
+  double     time_correction;       // remote to local clock offset (for BACKLOG_MAXAGE)
+  double     *d_chunk;              // chunklen * nchannels values pulled in one go
+  char       **str_chunk;           // same for strings
+  double     *ts_chunk;             // chunklen timestamps
+  double     *d_accum;              // running sum (MODE_MEAN) or latest sample (MODE_LATEST)
+  char       **str_latest;          // latest string sample (strings are always MODE_LATEST)
+  double     latest_ts;             // timestamp of the latest sample
+  int        accum_cnt;             // number of samples pulled since the last output
+
+  // sample accurate trigger output (-trigger), the listener is the only
+  // writer of trig_widx and the perform routine the only writer of trig_ridx
+  int             trigger;           // TRIGGER_OFF, TRIGGER_IMPULSE or TRIGGER_STEP
+  t_trigger_event trig_ring[TRIGGER_RINGLEN];
+  volatile int    trig_widx;
+  volatile int    trig_ridx;
+  double          trig_delay;        // ms between a marker's timestamp and its trigger
+  t_clock         *sync_clock;       // periodically refines clk_offset
+  double          clk_anchor;        // pd logical time the clock mapping is measured from
+  double          clk_offset;        // smoothed lsl local clock minus pd logical time (s)
+  int             clk_valid;
+  t_sample        trig_held;         // current value in TRIGGER_STEP mode
+  t_float         sr;
 
   // pd outlets
   t_outlet    *symbol_outlet;
   t_outlet    *float_outlet;
   t_outlet    *ts_outlet;
+  t_outlet    *trigger_outlet;      // only exists with -trigger
+  t_outlet    *info_outlet;         // appeared/disappeared messages from the directory
   
   // containers for lsl api
   lsl_inlet               lsl_inlet_obj;      // instantiation of the inlet class
-  lsl_streaminfo          lsl_info_list[50];  // to contain list returned by continuous resolver
-  int                     lsl_info_list_cnt;
+  t_pdlsl_list            info_list;          // the streams of the last listing, by index
   int                     which;
-  lsl_continuous_resolver lsl_cr;
+  lsl_streaminfo          stream_info;        // copy of the connected stream's info
+  t_symbol                *cache;             // -cache: file the connected stream is kept in
+  int                     bind_key;           // PDLSL_KEY_UID or PDLSL_KEY_SOURCE_ID of a bound stream
+  t_symbol                *bind_value;        // NULL if not bound
+  t_pdlsl_job             *job;               // query still out on the network
+  t_pdlsl_job             *meta_job;          // fetching the connected stream's full info
+  t_clock                 *meta_clock;
+  t_pdlsl_channels        chans;              // parsed from it, once per connection
+  t_pdlsl_watch           *watch;             // watch_by_predicate's own resolver, if any
+  t_clock                 *job_clock;         // picks up its results on pd's thread
   lsl_channel_format_t    type;
   float                   ts;
   int                     max_buflen;
@@ -52,278 +148,1093 @@ typedef struct _lsl_inlet{
   pthread_mutex_t listen_lock;
   pthread_t       tid;
   int             stop_;
-  int             can_launch_resolver;
   
 }t_lsl_inlet;
 
-// for launching the resolve threads
-typedef struct _prop_strct{
-  t_lsl_inlet *x;
-  int          argc;
-  t_atom      *argv;
-}t_prop_strct;
-
 // listen thread function declaration:
-void *lsl_listen_thread(void *in);
+static void *lsl_listen_thread(void *in);
 
 // helper function declarations:
-void destroy_info_list(t_lsl_inlet *x);
-void post_info_list(t_lsl_inlet *x);
-int prop_resolve(t_lsl_inlet *x, int argc, t_atom *argv);
+static void prop_query(t_lsl_inlet *x, int argc, t_atom *argv, int connect);
+static void deliver_prop_results(t_lsl_inlet *x, char *pred, int connect);
+static int start_job(t_lsl_inlet *x, t_pdlsl_job *job);
+static void load_cache(t_lsl_inlet *x);
+static void lsl_inlet_job_poll(t_lsl_inlet *x);
+static void setup_sample_buffers(t_lsl_inlet *x);
+static void free_sample_buffers(t_lsl_inlet *x);
+static void lsl_inlet_poll(t_lsl_inlet *x);
+static void lsl_inlet_poll_regular(t_lsl_inlet *x);
+static int parse_mode(t_lsl_inlet *x, t_symbol *s);
+static int parse_backlog(t_lsl_inlet *x, int argc, t_atom *argv);
+static void push_trigger(t_lsl_inlet *x, double t, t_sample val);
+static void lsl_inlet_sync(t_lsl_inlet *x);
+static double block_lsl_time(t_lsl_inlet *x);
+static void lsl_inlet_stream_event(void *owner, t_symbol *s, t_pdlsl_entry *e);
+static int connect_info(t_lsl_inlet *x, lsl_streaminfo info, lsl_inlet in);
+static void stop_listening(t_lsl_inlet *x);
+static int same_shape(t_lsl_inlet *x, lsl_streaminfo info);
+static void swap_inlet(t_lsl_inlet *x, lsl_streaminfo info);
+static void follow_binding(t_lsl_inlet *x, t_pdlsl_entry *e);
+static void fetch_channels(t_lsl_inlet *x);
+static void drop_meta_job(t_lsl_inlet *x);
+static void lsl_inlet_meta_poll(t_lsl_inlet *x);
+static void got_channels(t_lsl_inlet *x, lsl_streaminfo full);
+static void set_selection(t_lsl_inlet *x, int argc, t_atom *argv);
+static void resolve_selection(t_lsl_inlet *x);
+static void output_frame(t_lsl_inlet *x, double ts);
+
+// pd method declarations (needed by the helpers):
+void lsl_inlet_connect_by_idx(t_lsl_inlet *x, t_floatarg f);
+
+// listen thread functions:
+// the listener never touches pd, it only pulls samples into the queue
+// (or the accumulator for regular streams) which gets drained by
+// lsl_inlet_poll on pd's thread
+
+// pull up to n samples that are already waiting into the chunk buffer
+// starting at sample offset, returns the number of samples pulled
+static int pull_waiting(t_lsl_inlet *x, int offset, int n){
+
+  int ec = lsl_no_error;
+  unsigned long got;
+
+  if(n>x->chunklen-offset)n = x->chunklen-offset;
+  if(n<=0)return 0;
+  if(x->type == cft_string)
+    got = lsl_pull_chunk_str(x->lsl_inlet_obj, x->str_chunk + offset*x->nchannels, x->ts_chunk + offset,
+			     n * x->nchannels, n, 0.0, &ec);
+  else
+    got = lsl_pull_chunk_d(x->lsl_inlet_obj, x->d_chunk + offset*x->nchannels, x->ts_chunk + offset,
+			   n * x->nchannels, n, 0.0, &ec);
+  if(ec!=lsl_no_error)return 0;
+  return (int)(got / x->nchannels);
+}
 
-// listen thread function:
-void *lsl_listen_thread(void *in){
+static void discard_chunk(t_lsl_inlet *x, int from, int to){
 
+  int i;
+  if(x->type == cft_string)
+    for(i=from*x->nchannels;i<to*x->nchannels;i++)lsl_destroy_string(x->str_chunk[i]);
+}
 
-  t_lsl_inlet *x = (t_lsl_inlet *)in;
-  
-  int ec;
-  lsl_channel_format_t type;
+// throw away everything but the newest backlog_newest samples that are
+// waiting upstream, a chunk at a time
+static void trim_to_newest(t_lsl_inlet *x, int waiting){
+
+  int to_drop = waiting - x->backlog_newest;
+  int n;
+
+  while(to_drop>0 && x->stop_==0){
+    n = pull_waiting(x, 0, to_drop);
+    if(n==0)break;
+    discard_chunk(x, 0, n);
+    to_drop -= n;
+  }
+}
+
+// returns 1 if there is a new estimate, otherwise the last one stays
+static int update_time_correction(t_lsl_inlet *x, double timeout){
 
-  type = lsl_get_channel_format(x->lsl_info_list[x->which]);
+  int ec = lsl_no_error;
+  double tc = lsl_time_correction(x->lsl_inlet_obj, timeout, &ec);
+  if(ec!=lsl_no_error)return 0;
+  x->time_correction = tc;
+  return 1;
+}
 
+static void listen_irregular(t_lsl_inlet *x){
+
+  int ec;
+  int i, j, n, waiting;
+  int replay = 1;                   // the first pull after a connect or swap gets the backlog
+  int tc_known = 0;                 // the two clocks can't be compared before the first estimate
+  int need_tc = (x->backlog != BACKLOG_ALL || x->trigger);
+  double tc_waited = 0.0;
+  double ts;
+  double now = 0.0;
+  char **str_slot;
+  double *d_slot;
 
-  x->stop_ = 0;
   while(x->stop_==0){
-    pthread_mutex_lock(&x->listen_lock);
-    
-    if(type == cft_string)
-      x->ts = lsl_pull_sample_str(x->lsl_inlet_obj, &x->str_marker, 1, LSL_FOREVER, &ec);
+
+    // the first estimate is a network round trip, later ones are cached.
+    // it is asked for a pull timeout at a time so that stopping the
+    // listener (pd's thread joins it) is never held up by it, and the
+    // samples wait upstream until there is one or TC_WAIT has passed
+    if(need_tc && !tc_known && tc_waited < TC_WAIT){
+      tc_known = update_time_correction(x, x->lsl_pull_timeout);
+      tc_waited += x->lsl_pull_timeout;
+      if(!tc_known && tc_waited < TC_WAIT)continue;
+    }
+
+    // wait for the next sample to show up
+    ec = lsl_no_error;
+    if(x->type == cft_string)
+      ts = lsl_pull_sample_str(x->lsl_inlet_obj, x->str_chunk, x->nchannels, x->lsl_pull_timeout, &ec);
     else
-      x->ts = lsl_pull_sample_f(x->lsl_inlet_obj, &x->f_marker, 1, LSL_FOREVER, &ec);
+      ts = lsl_pull_sample_d(x->lsl_inlet_obj, x->d_chunk, x->nchannels, x->lsl_pull_timeout, &ec);
+
+    if(ec!=lsl_no_error || ts==0.0)continue; // timed out, check the stop flag again
+    x->ts_chunk[0] = ts;
+    n = 1;
+
+    if(x->backlog != BACKLOG_ALL || x->trigger){
+      if(lsl_was_clock_reset(x->lsl_inlet_obj)){
+	// the loop keeps asking if the new estimate isn't in yet
+	tc_known = update_time_correction(x, x->lsl_pull_timeout);
+	tc_waited = 0.0;
+	replay = 1;
+      }
+      now = lsl_local_clock();
+    }
+    // markers this old didn't just arrive, liblsl has recovered the
+    // connection and is handing over what piled up in the meantime
+    if(x->backlog == BACKLOG_NEWEST && tc_known &&
+       now - (ts + x->time_correction) > REPLAY_AGE)
+      replay = 1;
+
+    // anything else that is already waiting is handled in one go. only a
+    // backlog is trimmed, markers that just came in close together all
+    // go out
+    waiting = lsl_samples_available(x->lsl_inlet_obj);
+    if(replay && x->backlog == BACKLOG_NEWEST && 1+waiting > x->backlog_newest){
+      // the sample just pulled is the oldest of them all, so it goes and
+      // the newest backlog_newest are left upstream
+      discard_chunk(x, 0, 1);
+      trim_to_newest(x, waiting);
+      n = pull_waiting(x, 0, x->backlog_newest);
+    }
+    else if(waiting>0)
+      n += pull_waiting(x, 1, waiting);
+    replay = 0;
 
+    pthread_mutex_lock(&x->listen_lock);
+    for(j=0;j<n;j++){
+      if(x->backlog == BACKLOG_MAXAGE &&
+	 (now - (x->ts_chunk[j] + x->time_correction))*1000.0 > x->backlog_maxage){
+	// stale marker, nobody wants to hear about it anymore
+	discard_chunk(x, j, j+1);
+	continue;
+      }
+      if(x->trigger)
+	push_trigger(x, x->ts_chunk[j] + x->time_correction,
+		     (x->type == cft_string) ? 1 : (t_sample)x->d_chunk[j*x->nchannels]);
+      if(x->q_cnt == x->qlen){
+	// pd isn't keeping up, drop the incoming sample
+	x->q_dropped++;
+	discard_chunk(x, j, j+1);
+	continue;
+      }
+      if(x->type == cft_string){
+	str_slot = x->str_queue + x->q_widx * x->nchannels;
+	for(i=0;i<x->nchannels;i++)str_slot[i] = x->str_chunk[j*x->nchannels+i];
+      }
+      else{
+	d_slot = x->d_queue + x->q_widx * x->nchannels;
+	for(i=0;i<x->nchannels;i++)d_slot[i] = x->d_chunk[j*x->nchannels+i];
+      }
+      x->ts_queue[x->q_widx] = x->ts_chunk[j];
+      if(++x->q_widx == x->qlen)x->q_widx = 0;
+      x->q_cnt++;
+    }
     pthread_mutex_unlock(&x->listen_lock);
-    if(type == cft_string)
-      outlet_symbol(x->symbol_outlet,gensym(x->str_marker));
+
+  }
+}
+
+// regular streams are pulled a chunk at a time and folded into the
+// accumulator, so a 1kHz stream costs one lock per chunk and one pd
+// message per output interval instead of a message per sample
+static void listen_regular(t_lsl_inlet *x){
+
+  int ec;
+  int i, j, n;
+  double *d_frame;
+
+  while(x->stop_==0){
+
+    ec = lsl_no_error;
+    if(x->type == cft_string)
+      n = lsl_pull_chunk_str(x->lsl_inlet_obj, x->str_chunk, x->ts_chunk,
+			     x->chunklen * x->nchannels, x->chunklen, x->lsl_pull_timeout, &ec);
     else
-      outlet_float(x->float_outlet, x->f_marker);
-      outlet_float(x->ts_outlet, (float)x->ts);
+      n = lsl_pull_chunk_d(x->lsl_inlet_obj, x->d_chunk, x->ts_chunk,
+			   x->chunklen * x->nchannels, x->chunklen, x->lsl_pull_timeout, &ec);
+
+    if(ec!=lsl_no_error || n==0)continue;
+    n /= x->nchannels;
+
+    pthread_mutex_lock(&x->listen_lock);
+    if(x->type == cft_string){
+      // only the last sample of the chunk survives
+      for(i=0;i<x->nchannels;i++){
+	if(x->str_latest[i]!=NULL)lsl_destroy_string(x->str_latest[i]);
+	x->str_latest[i] = x->str_chunk[(n-1)*x->nchannels+i];
+      }
+      for(j=0;j<n-1;j++)
+	for(i=0;i<x->nchannels;i++)lsl_destroy_string(x->str_chunk[j*x->nchannels+i]);
+    }
+    else if(x->mode == MODE_MEAN){
+      if(x->accum_cnt==0)
+	for(i=0;i<x->nchannels;i++)x->d_accum[i] = 0.0;
+      for(j=0;j<n;j++){
+	d_frame = x->d_chunk + j*x->nchannels;
+	for(i=0;i<x->nchannels;i++)x->d_accum[i] += d_frame[i];
+      }
+    }
+    else{
+      d_frame = x->d_chunk + (n-1)*x->nchannels;
+      for(i=0;i<x->nchannels;i++)x->d_accum[i] = d_frame[i];
+    }
+    x->latest_ts = x->ts_chunk[n-1];
+    x->accum_cnt += n;
+    pthread_mutex_unlock(&x->listen_lock);
 
   }
-  
+}
+
+// single producer/single consumer handoff to the perform routine, no locks
+static void push_trigger(t_lsl_inlet *x, double t, t_sample val){
+
+  int widx = x->trig_widx;
+  int next = (widx + 1) & (TRIGGER_RINGLEN - 1);
+
+  if(next == x->trig_ridx)return; // full, the audio side has stalled
+  x->trig_ring[widx].t = t;
+  x->trig_ring[widx].val = val;
+  memory_barrier();
+  x->trig_widx = next;
+}
+
+static void *lsl_listen_thread(void *in){
+
+  t_lsl_inlet *x = (t_lsl_inlet *)in;
+
+  if(x->regular)listen_regular(x);
+  else listen_irregular(x);
+
   return NULL;
 }
 
+// out_atoms holds a sample of every channel, the selection (if any) picks
+// from it without a lookup: the labels were resolved when they were given
+// or when the stream's desc came in
+static void output_frame(t_lsl_inlet *x, double ts){
 
-// helper functions:
-void destroy_info_list(t_lsl_inlet *x){
+  t_atom *out = x->out_atoms;
+  int i, n = x->nchannels;
+
+  if(x->nsel!=0){
+    if(!x->sel_ready)return;
+    for(i=0;i<x->nsel;i++){
+      if(x->sel_idx[i]>=0)x->sel_atoms[i] = x->out_atoms[x->sel_idx[i]];
+      else if(x->type == cft_string)SETSYMBOL(x->sel_atoms+i, &s_);
+      else SETFLOAT(x->sel_atoms+i, 0);
+    }
+    out = x->sel_atoms;
+    n = x->nsel;
+  }
+  if(x->type == cft_string){
+    if(n == 1)
+      outlet_symbol(x->symbol_outlet, atom_getsymbol(out));
+    else
+      outlet_list(x->symbol_outlet, &s_list, n, out);
+  }
+  else{
+    if(n == 1)
+      outlet_float(x->float_outlet, atom_getfloat(out));
+    else
+      outlet_list(x->float_outlet, &s_list, n, out);
+  }
+  outlet_float(x->ts_outlet, (t_float)ts);
+}
+
+// clock method: output everything the listener has queued up
+static void lsl_inlet_poll(t_lsl_inlet *x){
 
   int i;
+  double ts;
+  char **str_slot;
+  double *d_slot;
 
-  for(i=0;i<50;i++){
-    if(x->lsl_info_list[i] != NULL){
-      lsl_destroy_streaminfo(x->lsl_info_list[i]);
-      x->lsl_info_list[i] = NULL;
+  if(x->regular){
+    lsl_inlet_poll_regular(x);
+    return;
+  }
+
+  while(1){
+    pthread_mutex_lock(&x->listen_lock);
+    if(x->q_cnt == 0){
+      pthread_mutex_unlock(&x->listen_lock);
+      break;
+    }
+    // copy the sample out so the listener can reuse the slot while we output
+    if(x->type == cft_string){
+      str_slot = x->str_queue + x->q_ridx * x->nchannels;
+      for(i=0;i<x->nchannels;i++){
+	SETSYMBOL(x->out_atoms+i, gensym(str_slot[i]));
+	lsl_destroy_string(str_slot[i]);
+	str_slot[i] = NULL;
+      }
     }
+    else{
+      d_slot = x->d_queue + x->q_ridx * x->nchannels;
+      for(i=0;i<x->nchannels;i++)
+	SETFLOAT(x->out_atoms+i, (t_float)d_slot[i]);
+    }
+    ts = x->ts_queue[x->q_ridx];
+    if(++x->q_ridx == x->qlen)x->q_ridx = 0;
+    x->q_cnt--;
+    pthread_mutex_unlock(&x->listen_lock);
+
+    output_frame(x, ts);
+  }
+
+  if(x->q_dropped!=0){
+    pd_error(x, "lsl_inlet: dropped %d samples, pd is not keeping up with the stream", x->q_dropped);
+    x->q_dropped = 0;
   }
-  x->lsl_info_list_cnt=0;
+
+  if(x->stop_==0)clock_delay(x->poll_clock, x->poll_interval);
 }
 
-void post_info_list(t_lsl_inlet *x){
-  
+// clock method for regular streams: one sample (or the average) per interval
+static void lsl_inlet_poll_regular(t_lsl_inlet *x){
+
+  int i;
+  int cnt;
+  double ts;
+
+  pthread_mutex_lock(&x->listen_lock);
+  cnt = x->accum_cnt;
+  if(cnt!=0){
+    if(x->type == cft_string)
+      for(i=0;i<x->nchannels;i++)
+	SETSYMBOL(x->out_atoms+i, gensym(x->str_latest[i]));
+    else if(x->mode == MODE_MEAN)
+      for(i=0;i<x->nchannels;i++)
+	SETFLOAT(x->out_atoms+i, (t_float)(x->d_accum[i]/(double)cnt));
+    else
+      for(i=0;i<x->nchannels;i++)
+	SETFLOAT(x->out_atoms+i, (t_float)x->d_accum[i]);
+    ts = x->latest_ts;
+    x->accum_cnt = 0;
+  }
+  pthread_mutex_unlock(&x->listen_lock);
+
+  // nothing new arrived, don't repeat the last output
+  if(cnt!=0)output_frame(x, ts);
+
+  if(x->stop_==0)clock_delay(x->poll_clock, x->interval);
+}
+
+// backlog all | backlog maxage <ms> | backlog newest <count>
+// returns the number of atoms consumed, 0 on error
+static int parse_backlog(t_lsl_inlet *x, int argc, t_atom *argv){
+
+  t_symbol *policy = atom_getsymbolarg(0, argc, argv);
+  t_float val = atom_getfloatarg(1, argc, argv);
+
+  if(!strcmp(policy->s_name, "all")){
+    x->backlog = BACKLOG_ALL;
+    return 1;
+  }
+  else if(!strcmp(policy->s_name, "maxage") && argc>1){
+    x->backlog_maxage = (val<0)?0:val;
+    x->backlog = BACKLOG_MAXAGE;
+    return 2;
+  }
+  else if(!strcmp(policy->s_name, "newest") && argc>1){
+    x->backlog_newest = (val<1)?1:(int)val;
+    x->backlog = BACKLOG_NEWEST;
+    return 2;
+  }
+  pd_error(x, "lsl_inlet: backlog: %s: unknown policy or argument missing (must be all, maxage <ms>, or newest <count>)",
+	   policy->s_name);
+  return 0;
+}
+
+static int parse_mode(t_lsl_inlet *x, t_symbol *s){
+
+  if(!strcmp(s->s_name, "latest"))return MODE_LATEST;
+  else if(!strcmp(s->s_name, "mean"))return MODE_MEAN;
+  pd_error(x, "lsl_inlet: %s: unknown mode (must be latest or mean)", s->s_name);
+  return -1;
+}
+
+// helper functions:
+
+// the list has been filled, by the directory or by a worker
+static void deliver_prop_results(t_lsl_inlet *x, char *pred, int connect){
+
+  if(x->info_list.n==0 && pred[0]=='\0')
+    post("lsl_inlet: nothing usable in %s", x->cache->s_name);
+  else if(x->info_list.n==0 && !strcmp(pred, "true()"))
+    post("no streams available");
+  else if(x->info_list.n==0)
+    post("could not find any streams matching %s", pred);
+  else if(connect)
+    lsl_inlet_connect_by_idx(x, 0);
+  else
+    pdlsl_list_post(&x->info_list);
+}
+
+static void lsl_inlet_job_poll(t_lsl_inlet *x){
+
+  t_pdlsl_job *job = x->job;
+
+  if(!pdlsl_job_done(job)){
+    clock_delay(x->job_clock, JOB_POLL);
+    return;
+  }
+  // the job is cleared before anything goes out
+  x->job = NULL;
+  pdlsl_job_collect(job, &x->info_list);
+  if(job->inlet!=NULL){
+    // the cached stream answered and its inlet is open already
+    stop_listening(x);
+    if(connect_info(x, pdlsl_list_info(&x->info_list, 0), job->inlet))x->which = 0;
+    job->inlet = NULL;
+  }
+  else deliver_prop_results(x, job->pred, job->connect);
+  pdlsl_job_release(job);
+}
+
+// list_by_* and resolve_by_*: every -field value pair has to match. streams
+// the registry already knows about are found right away, otherwise a worker
+// asks the network with the query compiled to a predicate
+static void prop_query(t_lsl_inlet *x, int argc, t_atom *argv, int connect){
+
+  t_pdlsl_query q;
+  t_pdlsl_job *job;
+
+  if(!pdlsl_query_parse(&q, x, argc, argv))return;
+  if(x->job!=NULL){
+    post("LSL outlets cannot be listed at this time. Another query is already at work.");
+    return;
+  }
+
+  if(!pdlsl_registry_start(x))return;
+  pdlsl_list_clear(&x->info_list);
+  if(pdlsl_registry_query(&x->info_list, &q)!=0){
+    deliver_prop_results(x, q.pred, connect);
+    return;
+  }
+
+  job = pdlsl_job_new();
+  strcpy(job->pred, q.pred);
+  job->connect = connect;
+  if(start_job(x, job))
+    post("Attempting to find LSL outlets with %s on the network...", q.pred);
+}
+
+static int start_job(t_lsl_inlet *x, t_pdlsl_job *job){
+
+  if(!pdlsl_job_start(job, x))return 0;
+  x->job = job;
+  clock_delay(x->job_clock, JOB_POLL);
+  return 1;
+}
+
+// -cache: connect to the stream from last time without waiting for a resolve
+static void load_cache(t_lsl_inlet *x){
+
+  t_pdlsl_job *job;
+  int size;
+  char *xml = pdlsl_cache_read(x->cache, &size);
+
+  if(xml==NULL)return;
+  job = pdlsl_job_new();
+  job->xml = xml;
+  job->xml_size = size;
+  job->connect = 1;
+  if(start_job(x, job))post("lsl_inlet: trying the stream in %s", x->cache->s_name);
+}
+
+// the registry's directory changed
+static void lsl_inlet_stream_event(void *owner, t_symbol *s, t_pdlsl_entry *e){
+
+  t_lsl_inlet *x = (t_lsl_inlet *)owner;
+  t_atom at[3];
+
+  SETSYMBOL(at, e->key[PDLSL_KEY_NAME]);
+  SETSYMBOL(at+1, e->key[PDLSL_KEY_TYPE]);
+  SETSYMBOL(at+2, e->key[PDLSL_KEY_SOURCE_ID]);
+  outlet_anything(x->info_outlet, s, 3, at);
+
+  if(s==gensym("appeared"))follow_binding(x, e);
+  else if(s==gensym("disappeared") && x->bind_value!=NULL && x->stream_info!=NULL &&
+	  !strcmp(lsl_get_uid(x->stream_info), e->key[PDLSL_KEY_UID]->s_name))
+    post("lsl_inlet: lost %s, waiting for it to come back", e->key[PDLSL_KEY_NAME]->s_name);
+}
+
+// bound streams: whatever matches the binding when it (re)appears, e.g.
+// because its outlet was restarted, is connected to right away
+static void follow_binding(t_lsl_inlet *x, t_pdlsl_entry *e){
+
+  if(x->bind_value==NULL || e->key[x->bind_key]!=x->bind_value)return;
+  if(x->stream_info!=NULL && !strcmp(lsl_get_uid(x->stream_info), e->key[PDLSL_KEY_UID]->s_name))
+    return;
+  if(same_shape(x, e->info))swap_inlet(x, e->info);
+  else{
+    stop_listening(x);
+    connect_info(x, e->info, NULL);
+  }
+}
+
+// a stream with the same format, channel count and rate can go on in the
+// buffers (and with the queue and accumulator) of the last one
+static int same_shape(t_lsl_inlet *x, lsl_streaminfo info){
+
+  if(x->stop_!=0 || x->stream_info==NULL)return 0;
+  return lsl_get_channel_format(info)==x->type &&
+    lsl_get_channel_count(info)==x->nchannels &&
+    lsl_get_nominal_srate(info)==lsl_get_nominal_srate(x->stream_info);
+}
+
+// only the liblsl inlet and the listener are replaced, the listener is
+// back within one pull timeout
+static void swap_inlet(t_lsl_inlet *x, lsl_streaminfo info){
+
+  post("lsl_inlet: switching to %s (%s)", lsl_get_name(info), lsl_get_uid(info));
+  x->stop_ = 1;
+  pthread_join(x->tid, NULL);
+  lsl_destroy_inlet(x->lsl_inlet_obj);
+  lsl_destroy_streaminfo(x->stream_info);
+  x->stream_info = lsl_copy_streaminfo(info);
+  x->lsl_inlet_obj = lsl_create_inlet(info, 300, LSL_NO_PREFERENCE, 1);
+  x->stop_ = 0;
+  if(pthread_create(&x->tid, NULL, lsl_listen_thread, (void *)x)!=0){
+    pd_error(x, "Error launching listener thread");
+    x->stop_ = 1;
+    x->which = -1;
+    clock_unset(x->poll_clock);
+    lsl_destroy_inlet(x->lsl_inlet_obj);
+    x->lsl_inlet_obj = NULL;
+    free_sample_buffers(x);
+    lsl_destroy_streaminfo(x->stream_info);
+    x->stream_info = NULL;
+    return;
+  }
+  if(x->cache!=NULL)pdlsl_cache_write(x->cache, x->stream_info);
+  // the last stream's table does until this one's arrives
+  fetch_channels(x);
+}
+
+// labels and units live in the desc, which only comes with the full info.
+// a worker fetches it right after connecting and the channel table is
+// parsed from it once, samples flow in the meantime
+static void fetch_channels(t_lsl_inlet *x){
+
+  t_pdlsl_job *job;
+
+  drop_meta_job(x);
+  if(pdlsl_channels_described(x->stream_info)){
+    got_channels(x, x->stream_info);
+    return;
+  }
+  job = pdlsl_job_new();
+  job->info = lsl_copy_streaminfo(x->stream_info);
+  if(pdlsl_job_start(job, x)){
+    x->meta_job = job;
+    clock_delay(x->meta_clock, JOB_POLL);
+  }
+  else got_channels(x, NULL);
+}
+
+// a worker still out on the network frees the job when it comes back
+static void drop_meta_job(t_lsl_inlet *x){
+
+  if(x->meta_job==NULL)return;
+  clock_unset(x->meta_clock);
+  pdlsl_job_release(x->meta_job);
+  x->meta_job = NULL;
+}
+
+static void lsl_inlet_meta_poll(t_lsl_inlet *x){
+
+  t_pdlsl_job *job = x->meta_job;
+  lsl_streaminfo full;
+
+  if(!pdlsl_job_done(job)){
+    clock_delay(x->meta_clock, JOB_POLL);
+    return;
+  }
+  x->meta_job = NULL;
+  full = pdlsl_job_take(job);
+  pdlsl_job_release(job);
+  if(full==NULL)post("lsl_inlet: no metadata for %s", lsl_get_name(x->stream_info));
+  got_channels(x, full);
+  if(full!=NULL)lsl_destroy_streaminfo(full);
+}
+
+// the labels go out of the info outlet, so the patch can see what there is
+static void got_channels(t_lsl_inlet *x, lsl_streaminfo full){
+
+  t_atom *at;
   int i;
-  int cnt = (x->lsl_info_list_cnt>=50)?50:x->lsl_info_list_cnt;
-  post("----------available lsl streams------------");
-  for(i=0;i<cnt;i++){
-    post("[%d] name: %s  |  type: %s  |  source_id: %s",
-    	 i,
-    	 lsl_get_name(x->lsl_info_list[i]),
-    	 lsl_get_type(x->lsl_info_list[i]),
-    	 lsl_get_source_id(x->lsl_info_list[i]));
+
+  if(pdlsl_channels_parse(&x->chans, full, x->nchannels)!=0){
+    at = (t_atom *)t_getbytes(sizeof(t_atom) * x->chans.n);
+    for(i=0;i<x->chans.n;i++)SETSYMBOL(at+i, x->chans.label[i]);
+    outlet_anything(x->info_outlet, gensym("labels"), x->chans.n, at);
+    t_freebytes(at, sizeof(t_atom) * x->chans.n);
   }
+  // channel numbers didn't have to wait for this
+  for(i=0;i<x->nsel;i++)
+    if(x->sel[i].a_type==A_SYMBOL){
+      resolve_selection(x);
+      break;
+    }
 }
 
-int prop_resolve(t_lsl_inlet *x, int argc, t_atom *argv){
+// keeps a copy of the selection, it is resolved whenever the stream changes
+static void set_selection(t_lsl_inlet *x, int argc, t_atom *argv){
 
-  t_symbol *arg;
-  int resolved_count = 0;
   int i;
-  t_atom *outv;
 
-  post("prop_resolve x: %d, argc %d, argv %d", x, argc, argv);
-  
-  for(i=0;i<50;i++){
-    if(x->lsl_info_list[i] == NULL)break;
-    else{
-      lsl_destroy_streaminfo(x->lsl_info_list[i]);
-      x->lsl_info_list[i] = NULL;
+  if(x->nsel!=0){
+    t_freebytes(x->sel, sizeof(t_atom) * x->nsel);
+    t_freebytes(x->sel_idx, sizeof(int) * x->nsel);
+    t_freebytes(x->sel_atoms, sizeof(t_atom) * x->nsel);
+    x->sel = x->sel_atoms = NULL;
+    x->sel_idx = NULL;
+  }
+  x->nsel = argc;
+  x->sel_ready = 1;
+  if(argc==0)return;
+  x->sel = (t_atom *)t_getbytes(sizeof(t_atom) * argc);
+  x->sel_idx = (int *)t_getbytes(sizeof(int) * argc);
+  x->sel_atoms = (t_atom *)t_getbytes(sizeof(t_atom) * argc);
+  for(i=0;i<argc;i++){
+    x->sel[i] = argv[i];
+    x->sel_idx[i] = -1;
+  }
+}
+
+// nothing comes out while a label can't be looked up yet, a channel that
+// doesn't exist comes out as 0 (or an empty symbol) so the others stay put
+static void resolve_selection(t_lsl_inlet *x){
+
+  int i, idx;
+
+  if(x->nsel==0 || x->stream_info==NULL)return;
+  x->sel_ready = 1;
+  for(i=0;i<x->nsel;i++)
+    if(x->sel[i].a_type==A_SYMBOL && x->chans.n==0)x->sel_ready = 0;
+  if(!x->sel_ready)return;
+
+  for(i=0;i<x->nsel;i++){
+    if(x->sel[i].a_type==A_FLOAT){
+      idx = (int)atom_getfloat(x->sel+i);
+      if(idx<0 || idx>=x->nchannels){
+	pd_error(x, "lsl_inlet: channels: %s has no channel %d", lsl_get_name(x->stream_info), idx);
+	idx = -1;
+      }
     }
+    else if((idx = pdlsl_channels_find(&x->chans, x->sel+i))<0)
+      pd_error(x, "lsl_inlet: channels: %s has no channel labelled %s",
+	       lsl_get_name(x->stream_info), atom_getsymbol(x->sel+i)->s_name);
+    x->sel_idx[i] = idx;
   }
-  
-  x->lsl_info_list_cnt = 0;
-  arg = atom_getsymbolarg(0, argc, argv);
-  if(!strcmp(arg->s_name, "-name"))
-      resolved_count = lsl_resolve_byprop(x->lsl_info_list, 50, "name", atom_getsymbolarg(1,argc,argv)->s_name,0,5);
+}
+
+// the sample and queue buffers are sized to the stream, so they are
+// (re)allocated on connect and never touched again until the next one
+static void setup_sample_buffers(t_lsl_inlet *x){
 
-  else if(!strcmp(arg->s_name, "-type"))
-      resolved_count = lsl_resolve_byprop(x->lsl_info_list, 50, "type", atom_getsymbolarg(1,argc,argv)->s_name,0,5);
+  int i;
 
-  else if(!strcmp(arg->s_name, "-source_id"))
-      resolved_count = lsl_resolve_byprop(x->lsl_info_list, 50, "source_id", atom_getsymbolarg(1,argc,argv)->s_name,0,5);
+  free_sample_buffers(x);
 
+  x->out_atoms = (t_atom *)t_getbytes(sizeof(t_atom) * x->nchannels);
+  x->ts_chunk = (double *)t_getbytes(sizeof(double) * x->chunklen);
+  if(x->type == cft_string)
+    x->str_chunk = (char **)t_getbytes(sizeof(char *) * x->nchannels * x->chunklen);
   else
-    pd_error(x, "lsl_inlet: %s: uniknown flag or argument missing", arg->s_name);
+    x->d_chunk = (double *)t_getbytes(sizeof(double) * x->nchannels * x->chunklen);
 
-  if(resolved_count!=0)
-      return(resolved_count);
+  if(x->regular){
+    if(x->type == cft_string){
+      x->str_latest = (char **)t_getbytes(sizeof(char *) * x->nchannels);
+      for(i=0;i<x->nchannels;i++)x->str_latest[i] = NULL;
+    }
+    else
+      x->d_accum = (double *)t_getbytes(sizeof(double) * x->nchannels);
+    x->accum_cnt = 0;
+  }
   else{
-    post("could not find any streams of property %s matching value %s", arg->s_name, atom_getsymbolarg(1,argc,argv)->s_name);
-    return 0;
+    x->ts_queue = (double *)t_getbytes(sizeof(double) * x->qlen);
+    if(x->type == cft_string){
+      x->str_queue = (char **)t_getbytes(sizeof(char *) * x->nchannels * x->qlen);
+      for(i=0;i<x->nchannels*x->qlen;i++)x->str_queue[i] = NULL;
+    }
+    else
+      x->d_queue = (double *)t_getbytes(sizeof(double) * x->nchannels * x->qlen);
+    x->q_widx = x->q_ridx = x->q_cnt = 0;
+    x->q_dropped = 0;
+  }
+}
+
+static void free_sample_buffers(t_lsl_inlet *x){
+
+  int i;
+
+  if(x->out_atoms!=NULL){
+    t_freebytes(x->out_atoms, sizeof(t_atom) * x->nchannels);
+    x->out_atoms = NULL;
+  }
+  if(x->ts_queue!=NULL){
+    t_freebytes(x->ts_queue, sizeof(double) * x->qlen);
+    x->ts_queue = NULL;
+  }
+  if(x->str_queue!=NULL){
+    // strings that never made it out still belong to liblsl
+    for(i=0;i<x->nchannels*x->qlen;i++)
+      if(x->str_queue[i]!=NULL)lsl_destroy_string(x->str_queue[i]);
+    t_freebytes(x->str_queue, sizeof(char *) * x->nchannels * x->qlen);
+    x->str_queue = NULL;
+  }
+  if(x->d_queue!=NULL){
+    t_freebytes(x->d_queue, sizeof(double) * x->nchannels * x->qlen);
+    x->d_queue = NULL;
+  }
+  if(x->ts_chunk!=NULL){
+    t_freebytes(x->ts_chunk, sizeof(double) * x->chunklen);
+    x->ts_chunk = NULL;
+  }
+  if(x->str_chunk!=NULL){
+    t_freebytes(x->str_chunk, sizeof(char *) * x->nchannels * x->chunklen);
+    x->str_chunk = NULL;
+  }
+  if(x->str_latest!=NULL){
+    for(i=0;i<x->nchannels;i++)
+      if(x->str_latest[i]!=NULL)lsl_destroy_string(x->str_latest[i]);
+    t_freebytes(x->str_latest, sizeof(char *) * x->nchannels);
+    x->str_latest = NULL;
+  }
+  if(x->d_chunk!=NULL){
+    t_freebytes(x->d_chunk, sizeof(double) * x->nchannels * x->chunklen);
+    x->d_chunk = NULL;
   }
+  if(x->d_accum!=NULL){
+    t_freebytes(x->d_accum, sizeof(double) * x->nchannels);
+    x->d_accum = NULL;
+  }
+}
+
+// dsp:
+// pd computes blocks ahead of real time in bursts, so the local lsl time
+// of a block is taken from a slowly smoothed mapping of pd's logical
+// time onto lsl_local_clock rather than from the clock read itself. the
+// mapping is refined from a pd clock every SYNC_INTERVAL ms, the perform
+// routine only reads it
+static void lsl_inlet_sync(t_lsl_inlet *x){
+
+  double raw = lsl_local_clock() - clock_gettimesince(x->clk_anchor) * 0.001;
+
+  if(!x->clk_valid){
+    x->clk_offset = raw;
+    x->clk_valid = 1;
+  }
+  else x->clk_offset += 0.02 * (raw - x->clk_offset);
+  clock_delay(x->sync_clock, SYNC_INTERVAL);
+}
+
+// pd has already moved its logical time past the block being computed,
+// so this is the lsl time just after the block's last sample
+static double block_lsl_time(t_lsl_inlet *x){
+
+  return clock_gettimesince(x->clk_anchor) * 0.001 + x->clk_offset;
+}
+
+static t_int *lsl_inlet_perform(t_int *w){
+
+  t_lsl_inlet *x = (t_lsl_inlet *)(w[1]);
+  t_sample *out = (t_sample *)(w[2]);
+  int n = (int)(w[3]);
+  int i, idx, ridx;
+  double t_block;
+  t_trigger_event *ev;
+
+  if(x->trigger == TRIGGER_STEP)
+    for(i=0;i<n;i++)out[i] = x->trig_held;
+  else
+    for(i=0;i<n;i++)out[i] = 0;
+  // nothing can have been queued before the first connect, which starts the mapping
+  if(!x->clk_valid)return (w+4);
+
+  // markers are rendered trig_delay ms after their timestamp so that
+  // network jitter below that doesn't disturb their relative timing.
+  // t_block is the time of the block's first sample
+  t_block = block_lsl_time(x) - n / x->sr - x->trig_delay * 0.001;
+  ridx = x->trig_ridx;
+  while(ridx != x->trig_widx){
+    memory_barrier();
+    ev = x->trig_ring + ridx;
+    idx = (int)((ev->t - t_block) * x->sr);
+    if(idx >= n && idx < 2 * x->sr)break; // belongs to a later block
+    if(idx < 0 || idx >= n)idx = 0;       // late (or the clocks disagree), play it now
+    if(x->trigger == TRIGGER_STEP){
+      for(i=idx;i<n;i++)out[i] = ev->val;
+      x->trig_held = ev->val;
+    }
+    else out[idx] += ev->val;
+    ridx = (ridx + 1) & (TRIGGER_RINGLEN - 1);
+  }
+  x->trig_ridx = ridx;
+
+  return (w+4);
+}
+
+static void lsl_inlet_dsp(t_lsl_inlet *x, t_signal **sp){
+
+  if(x->trigger == TRIGGER_OFF)return;
+  x->sr = sp[0]->s_sr;
+  dsp_add(lsl_inlet_perform, 3, x, sp[0]->s_vec, sp[0]->s_n);
 }
 
 // pd methods:
-void lsl_inlet_disconnect(t_lsl_inlet *x){
+static void stop_listening(t_lsl_inlet *x){
   
   if(x->stop_!=1){
     post("disconnecting from %s stream %s (%s)...",
-	 lsl_get_type(x->lsl_info_list[x->which]),
-    	 lsl_get_name(x->lsl_info_list[x->which]),
-    	 lsl_get_source_id(x->lsl_info_list[x->which]));
+	 lsl_get_type(x->stream_info),
+    	 lsl_get_name(x->stream_info),
+    	 lsl_get_source_id(x->stream_info));
     x->stop_=1;
     x->which = -1;
-    // here we are forced to call the dreaded pthread_cancel
-    // because the lsl_inlet waits forever for a new sample to come in
-    // if a stream disappears before the thread exits, it will simply
-    // stick waiting for a new sample and joining the thread will
-    // halt pd in that state
-    pthread_cancel(x->tid);
-    // however, we manage all of our resources outside of that thread, so it's cool (I think...)
+    // the listener pulls with a short timeout and checks the stop flag
+    // in between, so joining costs at most lsl_pull_timeout and we no
+    // longer need the dreaded pthread_cancel
+    pthread_join(x->tid, NULL);
+    clock_unset(x->poll_clock);
     
     if(x->lsl_inlet_obj!=NULL){
       lsl_destroy_inlet(x->lsl_inlet_obj);
       x->lsl_inlet_obj=NULL;
     }
+    free_sample_buffers(x);
+    drop_meta_job(x);
+    pdlsl_channels_free(&x->chans);
+    lsl_destroy_streaminfo(x->stream_info);
+    x->stream_info = NULL;
     post("...disconnected");
   }
 }
 
-void lsl_inlet_connect_by_idx(t_lsl_inlet *x, t_floatarg f){
+void lsl_inlet_disconnect(t_lsl_inlet *x){
+
+  x->bind_value = NULL;
+  stop_listening(x);
+}
+
+// sets everything up for info (and copies it), returns 0 if it can't.
+// in is an inlet that has been opened on info already, or NULL
+static int connect_info(t_lsl_inlet *x, lsl_streaminfo info, lsl_inlet in){
 
   int ec;
 
-  if(x->lsl_info_list_cnt==0){
+  // the list may be replaced by the next listing while we are connected
+  x->stream_info = lsl_copy_streaminfo(info);
+  post("connecting to %s stream %s (%s)...",
+       lsl_get_type(info),
+       lsl_get_name(info),
+       lsl_get_source_id(info));
+    
+  // strings are output as symbols, every numeric format is converted to pd floats
+  x->type = lsl_get_channel_format(info);
+  if(x->type == cft_undefined){
+    pd_error(x, "requested stream has undefined channel format");
+    if(in!=NULL)lsl_destroy_inlet(in);
+    lsl_destroy_streaminfo(x->stream_info);
+    x->stream_info = NULL;
+    return 0;
+  }
+  // regular streams are delivered at the control rate set by -interval,
+  // the chunk has to hold at least one pull timeout's worth of samples
+  x->regular = (lsl_get_nominal_srate(info)!=0);
+  if(x->regular)
+    x->chunklen = 1 + (int)(lsl_get_nominal_srate(info) * x->lsl_pull_timeout * 2.0);
+  else
+    x->chunklen = 64;
+    
+  x->nchannels = lsl_get_channel_count(info);
+  setup_sample_buffers(x);
+  x->lsl_inlet_obj = (in!=NULL) ? in : lsl_create_inlet(info, 300, LSL_NO_PREFERENCE,1);
+    
+  post("...connected, launcing listener thread");
+  x->stop_ = 0;
+  ec = pthread_create(&x->tid, NULL, lsl_listen_thread, (void *)x);
+  if(ec!=0){
+    pd_error(x, "Error launching listener thread");
+    x->stop_ = 1;
+    lsl_destroy_inlet(x->lsl_inlet_obj);
+    x->lsl_inlet_obj = NULL;
+    free_sample_buffers(x);
+    lsl_destroy_streaminfo(x->stream_info);
+    x->stream_info = NULL;
+    return 0;
+  }
+  clock_delay(x->poll_clock, x->regular ? x->interval : 0);
+  // liblsl is loaded now, so the clock mapping for the triggers can start
+  if(x->trigger && !x->clk_valid)lsl_inlet_sync(x);
+  if(x->cache!=NULL)pdlsl_cache_write(x->cache, x->stream_info);
+  resolve_selection(x);
+  fetch_channels(x);
+  return 1;
+}
+
+void lsl_inlet_connect_by_idx(t_lsl_inlet *x, t_floatarg f){
+
+  if(x->info_list.n==0){
     post("No lsl_info objects available. Please try to resolve available LSL outlets.");
     return;
   }
-  else if((f>x->lsl_info_list_cnt)||(f<0)){
+  else if((f>=x->info_list.n)||(f<0)){
       post("Invalid selection from list of available outlets.");
       return;
   }
   else{
 
-    x->which = (int)f;
-    post("connecting to %s stream %s (%s)...",
-	 lsl_get_type(x->lsl_info_list[x->which]),
-    	 lsl_get_name(x->lsl_info_list[x->which]),
-	 lsl_get_source_id(x->lsl_info_list[x->which]));
-    //if(x->lsl_inlet_obj!=NULL)lsl_destroy_inlet(x->lsl_inlet_obj);
-    
-    if(lsl_get_channel_format(x->lsl_info_list[x->which])!=cft_string)
-      if(lsl_get_channel_format(x->lsl_info_list[x->which])!=cft_float32){
-	  pd_error(x, "requested stream has invalid channel format, only strings and floats allowed");
-	  return;
-	}
-    if(lsl_get_nominal_srate(x->lsl_info_list[x->which])!=0){
-      	  pd_error(x, "requested stream has invalid nominal sampling rate, this must be 0");
-	  return;
-    }
-    
-    x->lsl_inlet_obj = lsl_create_inlet(x->lsl_info_list[x->which], 300, LSL_NO_PREFERENCE,1);
-    
-    post("...connected, launcing listener thread");
-    ec = pthread_create(&x->tid, NULL, lsl_listen_thread, (void *)x);
-    if(ec!=0){
-      pd_error(x, "Error launching listener thread");
-      return;
-    }
+    lsl_inlet_disconnect(x);
+    if(connect_info(x, pdlsl_list_info(&x->info_list, (int)f), NULL))x->which = (int)f;
   }
 }
 
-// this works:
-void *list_all_thread(void *in){
-  
-  t_lsl_inlet *x = (t_lsl_inlet *)in;
-  int listed_count;
-  post("Attempting to find LSL outlets on the network...");
-  listed_count = lsl_resolve_all(x->lsl_info_list, 50, 5);
-  if(listed_count!=0){
-    x->lsl_info_list_cnt = (listed_count>50?50:listed_count);
-    post_info_list(x);
+// bind -uid <uid> | bind -source_id <source_id>: connects to the stream
+// now or as soon as it shows up, and again whenever it comes back.
+// -source_id survives a restart of the outlet, -uid only a lost connection
+void lsl_inlet_bind(t_lsl_inlet *x, t_symbol *s, int argc, t_atom *argv){
+
+  t_symbol *flag = atom_getsymbolarg(0, argc, argv);
+  t_pdlsl_list found;
+  int key;
+
+  if(!strcmp(flag->s_name, "-uid"))key = PDLSL_KEY_UID;
+  else if(!strcmp(flag->s_name, "-source_id"))key = PDLSL_KEY_SOURCE_ID;
+  else{
+    pd_error(x, "lsl_inlet: bind: %s: unknown flag (must be -uid or -source_id)", flag->s_name);
+    return;
   }
-  else post("no streams available");
-  
-  x->can_launch_resolver = 1;
-  return NULL;
+  if(argc<2){
+    pd_error(x, "lsl_inlet: bind: %s: argument missing", flag->s_name);
+    return;
+  }
+  if(!pdlsl_registry_start(x))return;
+  lsl_inlet_disconnect(x);
+  x->bind_key = key;
+  x->bind_value = atom_getsymbolarg(1, argc, argv);
+
+  // the newest match, if the directory already knows it
+  pdlsl_list_init(&found);
+  if(pdlsl_registry_find(&found, key, x->bind_value)!=0)
+    follow_binding(x, found.v[found.n-1]);
+  else
+    post("lsl_inlet: waiting for %s %s to appear", flag->s_name+1, x->bind_value->s_name);
+  pdlsl_list_free(&found);
+}
+
+void lsl_inlet_unbind(t_lsl_inlet *x){
+
+  x->bind_value = NULL;
+}
+
+void lsl_inlet_mode(t_lsl_inlet *x, t_symbol *s){
+
+  int mode = parse_mode(x, s);
+  if(mode<0)return;
+  pthread_mutex_lock(&x->listen_lock);
+  x->mode = mode;
+  x->accum_cnt = 0;
+  pthread_mutex_unlock(&x->listen_lock);
 }
+
+void lsl_inlet_interval(t_lsl_inlet *x, t_floatarg f){
+
+  x->interval = (f<1)?1:f;
+}
+
+// the listener only reads the policy fields, so a torn update costs at
+// most one misjudged marker
+void lsl_inlet_backlog(t_lsl_inlet *x, t_symbol *s, int argc, t_atom *argv){
+
+  parse_backlog(x, argc, argv);
+}
+
+void lsl_inlet_delay(t_lsl_inlet *x, t_floatarg f){
+
+  x->trig_delay = (f<0)?0:f;
+}
+
+// channels Cz Pz Oz: only these channels come out, in this order. labels
+// and channel numbers (from 0) can be mixed, no arguments for all of them
+void lsl_inlet_channels(t_lsl_inlet *x, t_symbol *s, int argc, t_atom *argv){
+
+  set_selection(x, argc, argv);
+  resolve_selection(x);
+}
+
+// the registry is kept current in the background, so listing is only a lookup
 void lsl_inlet_list_all(t_lsl_inlet *x){
-  
-  int ec;
-  pthread_t tid;
-  if(x->can_launch_resolver == 0)
-    post("LSL outlets cannot be listed at this time. Another process is already at work.");
-  else{
-    x->can_launch_resolver = 0; // weak locking
-    ec = pthread_create(&tid, NULL, list_all_thread, (void *)x);
-    if(ec!=0){
-      pd_error(x, "Error launching list all thread");
+
+  t_pdlsl_job *job;
+  int started = pdlsl_registry_start(x);
+
+  if(!started)return;
+  // a registry that has only just started hasn't heard from anybody yet,
+  // so the first listing asks the network for everything instead
+  if(started==PDLSL_STARTED_NOW){
+    if(x->job!=NULL){
+      post("LSL outlets cannot be listed at this time. Another query is already at work.");
       return;
     }
+    pdlsl_list_clear(&x->info_list);
+    job = pdlsl_job_new();
+    strcpy(job->pred, "true()");
+    if(start_job(x, job))post("Attempting to find LSL outlets on the network...");
+    return;
   }
+  pdlsl_list_clear(&x->info_list);
+  if(pdlsl_registry_find(&x->info_list, -1, NULL)!=0)pdlsl_list_post(&x->info_list);
+  else post("no streams available");
 }
 
-// but for some reason this doesn't work:
-/* void *list_by_property_thread(void *in){ */
-
-/*   t_prop_strct *y = (t_prop_strct *)in; */
-/*   int listed_count; */
-/*   post("thread x: %d, argc %d, argv %d", y->x, y->argc, y->argv); */
-/*   listed_count = prop_resolve(y->x, y->argc, y->argv); */
-/*   if(listed_count!=0){ */
-/*     y->x->lsl_info_list_cnt = (listed_count>50?50:listed_count); */
-/*     post_info_list(y->x); */
-/*   } */
- 
-/*   y->x->can_launch_resolver = 1; */
-/*   return NULL; */
-/* } */
 void lsl_inlet_list_by_property(t_lsl_inlet *x, t_symbol *s, int argc, t_atom *argv){
 
-    int listed_count;
-    //post("thread x: %d, argc %d, argv %d", y->x, y->argc, y->argv);
-  listed_count = prop_resolve(x, argc, argv);
-  if(listed_count!=0){
-    x->lsl_info_list_cnt = (listed_count>50?50:listed_count);
-    post_info_list(x);
-  }
-
-  // doesn't work:
-  /* int ec; */
-  /* pthread_t tid; */
-  /* t_prop_strct y; */
-  /* post("before pack x: %d, argc %d, argv %d", x, argc, argv); */
-  /* y.x = x; */
-  /* y.argc = argc; */
-  /* y.argv = argv; */
-  /* post("after pack x: %d, argc %d, argv %d", y.x, y.argc, y.argv); */
-  /* if(x->can_launch_resolver == 0) */
-  /*   post("LSL outlets cannot be listed at this time. Another process is already at work."); */
-  /* else{ */
-  /*   x->can_launch_resolver = 0; // weak locking */
-  /*   ec = pthread_create(&tid, NULL, list_by_property_thread, (void *)&y); */
-  /*   if(ec!=0){ */
-  /*     pd_error(x, "Error launching list by property thread"); */
-  /*     return; */
-  /*   } */
-  /* } */
+  prop_query(x, argc, argv, 0);
 }
+
 void lsl_inlet_resolve_by_property(t_lsl_inlet *x, t_symbol *s, int argc, t_atom *argv){
 
-  x->lsl_info_list_cnt = 0;
-  x->lsl_info_list_cnt = prop_resolve(x, argc, argv);
-  if(x->lsl_info_list_cnt != 0)
-    lsl_inlet_connect_by_idx(x, 0);
-  
+  prop_query(x, argc, argv, 1);
+}
+
+// the same as the property methods, but with any number of conditions in mind
+void lsl_inlet_list_by_predicate(t_lsl_inlet *x, t_symbol *s, int argc, t_atom *argv){
+
+  prop_query(x, argc, argv, 0);
+}
+
+void lsl_inlet_resolve_by_predicate(t_lsl_inlet *x, t_symbol *s, int argc, t_atom *argv){
+
+  prop_query(x, argc, argv, 1);
+}
+
+// keeps a resolver of its own on the query, so only matching streams are
+// transferred, and reports matched/unmatched. no arguments stop it
+void lsl_inlet_watch_by_predicate(t_lsl_inlet *x, t_symbol *s, int argc, t_atom *argv){
+
+  t_pdlsl_query q;
+
+  if(x->watch!=NULL){
+    pdlsl_watch_free(x->watch);
+    x->watch = NULL;
+  }
+  if(argc==0)return;
+  if(!pdlsl_query_parse(&q, x, argc, argv))return;
+  x->watch = pdlsl_watch_new(q.pred, x, lsl_inlet_stream_event);
+  if(x->watch==NULL)pd_error(x, "lsl_inlet: could not watch for %s", q.pred);
 }
 
 
@@ -331,27 +1242,125 @@ void lsl_inlet_resolve_by_property(t_lsl_inlet *x, t_symbol *s, int argc, t_atom
 void *lsl_inlet_new(t_symbol *s, int argc, t_atom *argv){
 
   int i;
+  t_symbol *firstarg;
   t_lsl_inlet *x = (t_lsl_inlet *)pd_new(lsl_inlet_class);
 
-  // outlet to forward incoming LSL markers
+  // outlet to forward incoming LSL string markers (lists for multichannel streams)
   x->symbol_outlet = outlet_new(&x->x_obj, &s_symbol);
-  // reports the number of markers that came in on this bang
+  // outlet for numeric markers (lists for multichannel streams)
   x->float_outlet = outlet_new(&x->x_obj, &s_float);
   x->ts_outlet = outlet_new(&x->x_obj, &s_float);
   
   x->which = -1;
-  x->can_launch_resolver = 1;
 
   // defaults for the inlet
   x->max_buflen = 100; // 10000 samples
-
-  for(i=0;i<50;i++)
-    x->lsl_info_list[i] = NULL;
-  x->lsl_info_list_cnt = 0;
-  //x->lsl_inlet_obj = NULL;
-
-  x->listen_lock = PTHREAD_MUTEX_INITIALIZER;
+  x->lsl_pull_timeout = 0.05;
+  x->qlen = 1024;
+  x->poll_interval = 1;
+  x->regular = 0;
+  x->mode = MODE_LATEST;
+  x->interval = 20;
+  x->chunklen = 0;
+  x->backlog = BACKLOG_ALL;
+  x->backlog_maxage = 1000;
+  x->backlog_newest = 1;
+  x->time_correction = 0.0;
+  x->trigger = TRIGGER_OFF;
+  x->trig_delay = 20;
+  x->trig_widx = x->trig_ridx = 0;
+  x->trig_held = 0;
+  x->clk_anchor = clock_getlogicaltime();
+  x->clk_offset = 0;
+  x->clk_valid = 0;
+  x->sync_clock = clock_new(x, (t_method)lsl_inlet_sync);
+  x->sr = sys_getsr();
+  x->cache = NULL;
+  x->sel = x->sel_atoms = NULL;
+  x->sel_idx = NULL;
+  x->nsel = 0;
+  x->sel_ready = 1;
+
+  // parse creation args
+  while(argc > 0){
+    firstarg = atom_getsymbolarg(0, argc, argv);
+    if(!strcmp(firstarg->s_name, "-interval")){
+      lsl_inlet_interval(x, atom_getfloatarg(1, argc, argv));
+      argc-=2, argv+=2;
+    }
+    else if(!strcmp(firstarg->s_name, "-mode")){
+      i = parse_mode(x, atom_getsymbolarg(1, argc, argv));
+      if(i>=0)x->mode = i;
+      argc-=2, argv+=2;
+    }
+    else if(!strcmp(firstarg->s_name, "-trigger")){
+      if(!strcmp(atom_getsymbolarg(1, argc, argv)->s_name, "impulse"))x->trigger = TRIGGER_IMPULSE;
+      else if(!strcmp(atom_getsymbolarg(1, argc, argv)->s_name, "step"))x->trigger = TRIGGER_STEP;
+      else pd_error(x, "lsl_inlet: -trigger: %s: unknown mode (must be impulse or step)",
+		    atom_getsymbolarg(1, argc, argv)->s_name);
+      argc-=2, argv+=2;
+    }
+    else if(!strcmp(firstarg->s_name, "-delay")){
+      lsl_inlet_delay(x, atom_getfloatarg(1, argc, argv));
+      argc-=2, argv+=2;
+    }
+    else if(!strcmp(firstarg->s_name, "-cache") && argc>1){
+      x->cache = pdlsl_cache_path(atom_getsymbolarg(1, argc, argv)->s_name);
+      argc-=2, argv+=2;
+    }
+    else if(!strcmp(firstarg->s_name, "-channels")){
+      // everything up to the next flag
+      for(i=1;i<argc && !(argv[i].a_type==A_SYMBOL && argv[i].a_w.w_symbol->s_name[0]=='-');i++);
+      set_selection(x, i-1, argv+1);
+      argc-=i, argv+=i;
+    }
+    else if(!strcmp(firstarg->s_name, "-backlog")){
+      i = parse_backlog(x, argc-1, argv+1);
+      argc-=1+i, argv+=1+i;
+    }
+    else{
+      pd_error(x, "lsl_inlet: %s: unknown flag or argument missing", firstarg->s_name);
+      argc--, argv++;
+    }
+  }
+  // markers as sample accurate triggers come out of an extra signal outlet
+  x->trigger_outlet = NULL;
+  if(x->trigger != TRIGGER_OFF)
+    x->trigger_outlet = outlet_new(&x->x_obj, &s_signal);
+  x->info_outlet = outlet_new(&x->x_obj, 0);
+
+
+  pdlsl_list_init(&x->info_list);
+  x->lsl_inlet_obj = NULL;
+  x->stream_info = NULL;
+  x->bind_key = PDLSL_KEY_SOURCE_ID;
+  x->bind_value = NULL;
+
+  // the first object in starts the registry's resolver
+  pdlsl_registry_acquire(x, lsl_inlet_stream_event);
+  x->job = NULL;
+  x->watch = NULL;
+  x->job_clock = clock_new(x, (t_method)lsl_inlet_job_poll);
+  x->meta_job = NULL;
+  x->meta_clock = clock_new(x, (t_method)lsl_inlet_meta_poll);
+  pdlsl_channels_init(&x->chans);
+
+  x->nchannels = 0;
+  x->out_atoms = NULL;
+  x->str_queue = NULL;
+  x->d_queue = NULL;
+  x->ts_queue = NULL;
+  x->d_chunk = NULL;
+  x->str_chunk = NULL;
+  x->ts_chunk = NULL;
+  x->d_accum = NULL;
+  x->str_latest = NULL;
+  x->poll_clock = clock_new(x, (t_method)lsl_inlet_poll);
+
+  pthread_mutex_init(&x->listen_lock, NULL);
   x->stop_=1;
+
+  if(x->cache!=NULL)load_cache(x);
   
   return x;
     
@@ -360,9 +1369,19 @@ void *lsl_inlet_new(t_symbol *s, int argc, t_atom *argv){
 
 void lsl_inlet_free(t_lsl_inlet *x){
 
-  destroy_info_list(x);
   lsl_inlet_disconnect(x);
+  if(x->watch!=NULL)pdlsl_watch_free(x->watch);
+  pdlsl_list_free(&x->info_list);
+  pdlsl_registry_release(x);
   if(x->lsl_inlet_obj!=NULL)lsl_destroy_inlet(x->lsl_inlet_obj);
+  clock_free(x->poll_clock);
+  clock_free(x->sync_clock);
+  // a worker still out on the network frees the job when it comes back
+  clock_free(x->job_clock);
+  if(x->job!=NULL)pdlsl_job_release(x->job);
+  clock_free(x->meta_clock);
+  set_selection(x, 0, NULL);
+  pthread_mutex_destroy(&x->listen_lock);
 
 }
 
@@ -387,6 +1406,52 @@ void lsl_inlet_setup(void){
   		  A_DEFFLOAT,
   		  0);
     
+  class_addmethod(lsl_inlet_class,
+  		  (t_method)lsl_inlet_bind,
+  		  gensym("bind"),
+  		  A_GIMME,
+  		  0);
+    
+  class_addmethod(lsl_inlet_class,
+  		  (t_method)lsl_inlet_unbind,
+  		  gensym("unbind"),
+  		  0);
+    
+  class_addmethod(lsl_inlet_class,
+  		  (t_method)lsl_inlet_mode,
+  		  gensym("mode"),
+  		  A_SYMBOL,
+  		  0);
+    
+  class_addmethod(lsl_inlet_class,
+  		  (t_method)lsl_inlet_interval,
+  		  gensym("interval"),
+  		  A_FLOAT,
+  		  0);
+    
+  class_addmethod(lsl_inlet_class,
+  		  (t_method)lsl_inlet_backlog,
+  		  gensym("backlog"),
+  		  A_GIMME,
+  		  0);
+    
+  class_addmethod(lsl_inlet_class,
+  		  (t_method)lsl_inlet_delay,
+  		  gensym("delay"),
+  		  A_FLOAT,
+  		  0);
+    
+  class_addmethod(lsl_inlet_class,
+  		  (t_method)lsl_inlet_channels,
+  		  gensym("channels"),
+  		  A_GIMME,
+  		  0);
+    
+  class_addmethod(lsl_inlet_class,
+  		  (t_method)lsl_inlet_dsp,
+  		  gensym("dsp"),
+  		  0);
+    
   class_addmethod(lsl_inlet_class,
   		  (t_method)lsl_inlet_list_all,
   		  gensym("list_all"),
@@ -403,6 +1468,24 @@ void lsl_inlet_setup(void){
   		  gensym("resolve_by_property"),
   		  A_GIMME,
   		  0);
+  
+  class_addmethod(lsl_inlet_class,
+  		  (t_method)lsl_inlet_list_by_predicate,
+  		  gensym("list_by_predicate"),
+  		  A_GIMME,
+  		  0);
+  
+  class_addmethod(lsl_inlet_class,
+  		  (t_method)lsl_inlet_resolve_by_predicate,
+  		  gensym("resolve_by_predicate"),
+  		  A_GIMME,
+  		  0);
+  
+  class_addmethod(lsl_inlet_class,
+  		  (t_method)lsl_inlet_watch_by_predicate,
+  		  gensym("watch_by_predicate"),
+  		  A_GIMME,
+  		  0);
 
   /* class_addbang(lsl_inlet_class, */
   /* 		(t_method)lsl_inlet_bang); */
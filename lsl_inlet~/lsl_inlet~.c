@@ -8,21 +8,24 @@
 
 
 #include "m_pd.h"
-#include "lsl_c.h"
+#include "pdlsl_lib.h"
+#include "pdlsl_registry.h"
+#include "pdlsl_job.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-
+#include "pthread.h"
 
 #ifdef _WIN32
 #include "windows.h"
-#define TID  HANDLE
-#define MUTEX CRITICAL_SECTION
 #else
 #include <unistd.h>
-#include "pthread.h"
 #endif
 
+// the stream directory is the registry shared with every other object and
+// queries run on the workers of pdlsl_job (common/)
+#define JOB_POLL        50           // ms between checks on a query running on a worker
+
 //pd boilerplate:
 static t_class *lsl_inlet_tilde_class;
 
@@ -34,9 +37,11 @@ typedef struct _lsl_inlet_tilde{
   t_outlet   **sig_outlets;         // pd multiplexed signal outlet
   int        nout;                  // number of channels
   t_outlet   *ts_outlet;            // timestamp outlet
+  t_outlet   *info_outlet;          // appeared/disappeared messages from the directory
   t_sample   **lcl_outs;            // for convenience in the processing loop
 
   t_sample   **sig_buffs;           // ring buffers for holding lsl chunks as they arrive
+  int        nbuffs;                // one per channel, but never fewer than outlets
   t_sample   *ts_buf;               // ring buffer for timestamps
   int        buflen;                // length of ring buffer
   int        nchannels;             // number of channels in the lsl_inlet
@@ -58,50 +63,78 @@ typedef struct _lsl_inlet_tilde{
   
   // containers for lsl api
   lsl_inlet               lsl_inlet_obj;      // instantiation of the inlet class
-  lsl_streaminfo          lsl_info_list[50];  // to contain list returned by continuous resolver
-  int                     lsl_info_list_cnt;
+  t_pdlsl_list            info_list;          // the streams of the last listing, by index
   int                     which;
-  lsl_continuous_resolver lsl_cr;
+  lsl_streaminfo          stream_info;        // copy of the connected stream's info
+  t_symbol                *cache;             // -cache: file the connected stream is kept in
+  int                     bind_key;           // PDLSL_KEY_UID or PDLSL_KEY_SOURCE_ID of a bound stream
+  t_symbol                *bind_value;        // NULL if not bound
+  t_pdlsl_job             *job;               // query still out on the network
+  t_pdlsl_watch           *watch;             // watch_by_predicate's own resolver, if any
+  t_clock                 *job_clock;         // picks up its results on pd's thread
   lsl_channel_format_t    type;
   float                   ts;
+  int                     *route;             // the ring buffer each outlet plays
+  float                   *q_scale;           // and its gain and offset: int16 streams are dequantized
+  float                   *q_offset;          // as q * scale + offset, 0 mutes the outlet
+  t_pdlsl_job             *meta_job;          // fetching the connected stream's full info
+  t_clock                 *meta_clock;
+  t_pdlsl_channels        chans;              // parsed from it, once per connection
+  t_atom                  *sel;               // channels Cz Pz Oz, labels and/or channel numbers
+  int                     nsel;               // 0 for the first nout channels
+  int                     *sel_idx;           // resolved against the stream, -1 where there is no such channel
+  int                     sel_ready;          // 0 while labels wait for the stream's desc
   double                  lsl_pull_timeout;
   double                  lag_lsl;
   double                  cnt_lsl;
 
+  // crossfade from where the last stream left off when a bound stream
+  // comes back (see swap_inlet)
+  int                     fade_len;           // in samples
+  int                     fade;               // samples still to go
+  int                     fade_pending;       // start once the new stream delivers
+  t_sample                *fade_from;         // one per outlet
+  t_sample                *last_out;          // the last value of each outlet
+
   // threading variables for the listen thread and associated data
-  MUTEX           listen_lock;
-  TID             tid;
-  //pthread_mutex_t listen_lock;
-  //pthread_t       tid;
+  pthread_mutex_t listen_lock;
+  pthread_t       tid;
   int             stop_;
-  int             can_launch_resolver;
   
 }t_lsl_inlet_tilde;
 
 
-// for launching the resolve threads
-typedef struct _prop_strct{
-  
-  struct t_lsl_tilde_inlet *x;
-  int          argc;
-  t_atom      *argv;
-
-}t_prop_strct;
-
-
 // listen thread function declaration:
-//static void *lsl_listen_thread(void *in);
+static void *lsl_listen_thread(void *in);
 
 // helper function declarations:
-static void destroy_info_list(t_lsl_inlet_tilde *x);
-static void post_info_list(t_lsl_inlet_tilde *x);
-static int prop_resolve(t_lsl_inlet_tilde *x, int argc, t_atom *argv);
+static void prop_query(t_lsl_inlet_tilde *x, int argc, t_atom *argv, int connect);
+static void deliver_prop_results(t_lsl_inlet_tilde *x, char *pred, int connect);
+static int start_job(t_lsl_inlet_tilde *x, t_pdlsl_job *job);
+static void load_cache(t_lsl_inlet_tilde *x);
+static void lsl_inlet_tilde_job_poll(t_lsl_inlet_tilde *x);
 static void flush_lsl_buffers(t_lsl_inlet_tilde *x);
 static void free_lsl_buffers(t_lsl_inlet_tilde *x);
 static void setup_lsl_buffers(t_lsl_inlet_tilde *x);
+static void fetch_channels(t_lsl_inlet_tilde *x);
+static void drop_meta_job(t_lsl_inlet_tilde *x);
+static void lsl_inlet_tilde_meta_poll(t_lsl_inlet_tilde *x);
+static void got_channels(t_lsl_inlet_tilde *x, lsl_streaminfo full);
+static void set_selection(t_lsl_inlet_tilde *x, int argc, t_atom *argv);
+static void resolve_selection(t_lsl_inlet_tilde *x);
+static void update_route(t_lsl_inlet_tilde *x);
+static void lsl_inlet_tilde_stream_event(void *owner, t_symbol *s, t_pdlsl_entry *e);
+static int connect_info(t_lsl_inlet_tilde *x, lsl_streaminfo info, lsl_inlet in);
+static void stop_listening(t_lsl_inlet_tilde *x);
+static int same_shape(t_lsl_inlet_tilde *x, lsl_streaminfo info);
+static void swap_inlet(t_lsl_inlet_tilde *x, lsl_streaminfo info);
+static void follow_binding(t_lsl_inlet_tilde *x, t_pdlsl_entry *e);
+
+// pd method declarations (needed by the helpers):
+void lsl_inlet_tilde_connect_by_idx(t_lsl_inlet_tilde *x, t_floatarg f);
 
 /********spline interpolation*********/
-float spline_interpolate(t_float *buffer, long bufferLength, double findex)
+static float spline_interpolate(t_float *buffer, long bufferLength, double findex)
 {
 	long lindex = findex;
 	t_sample fr = findex - lindex;
@@ -124,10 +157,8 @@ float spline_interpolate(t_float *buffer, long bufferLength, double findex)
 static t_int *lsl_inlet_tilde_perform(t_int *w);
 
 // listen thread function:
-DWORD WINAPI lsl_listen_thread(void *in)
+static void *lsl_listen_thread(void *in)
 {
-	//static void *lsl_listen_thread(void *in){
-
 
 	t_lsl_inlet_tilde *x = (t_lsl_inlet_tilde *)in;
 
@@ -138,322 +169,617 @@ DWORD WINAPI lsl_listen_thread(void *in)
 	double *sample_d;
 	float *sample_f;
 	int *sample_i;
+	short *sample_s;
 
-	post("listening");
 	sample_d = (double *)t_getbytes(0);
 	sample_d = (double *)t_resizebytes(sample_d, 0, sizeof(double)*x->nchannels);
 	sample_f = (float *)t_getbytes(0);
 	sample_f = (float *)t_resizebytes(sample_f, 0, sizeof(float)*x->nchannels);
 	sample_i = (int *)t_getbytes(0);
 	sample_i = (int *)t_resizebytes(sample_i, 0, sizeof(int)*x->nchannels);
+	sample_s = (short *)t_getbytes(sizeof(short)*x->nchannels);
 
-	type = lsl_get_channel_format(x->lsl_info_list[x->which]);
-	post("connecting to %s...", lsl_get_name(x->lsl_info_list[x->which]));
-	x->lsl_inlet_obj = lsl_create_inlet(x->lsl_info_list[x->which], 300, 1, 1);
+	type = lsl_get_channel_format(x->stream_info);
+	post("connecting to %s...", lsl_get_name(x->stream_info));
+	// a cached stream comes with its inlet open already
+	if (x->lsl_inlet_obj == NULL)
+		x->lsl_inlet_obj = lsl_create_inlet(x->stream_info, 300, 1, 1);
 	if (x->lsl_inlet_obj != 0)
 		post("successfully connected");
 	else
 	{
 		post("could not establish lsl connection");
-		return 0;
+		return NULL;
 	}
 	x->connected = 1;
 
-	x->stop_ = 0;
-	post("%d", type);
-	x->cnt_lsl = 0.0;
 	while (x->stop_ == 0) 
 	{
 
-		switch (type) 
+		// a short timeout, so the stop flag is seen even if the stream is gone.
+		// int16 is half the bytes of float32 on the wire, the outlets scale it
+		// (see update_route) once the stream's desc has been fetched
+		switch (type)
 		{
-
 		case cft_float32:
-			ts = lsl_pull_sample_f(x->lsl_inlet_obj, sample_f, x->nchannels, LSL_FOREVER, &ec);
-			if (x->cnt_lsl <= x->lag_lsl)
-				x->cnt_lsl += x->sr_ratio;
-			//post("%d", x->widx);
-			EnterCriticalSection(&x->listen_lock);
-			for (i = 0; i < x->nchannels; i++)
-			{
-				
-				x->sig_buffs[i][x->widx] = (t_sample)sample_f[i];
-				//if (i == 0)
-				//	post("%f", x->sig_buffs[i][x->widx]);
-				//post("%f %d\n", sample_f[i], i);
-			}
-			x->ts_buf[x->widx++] = (t_sample)ts;
-			x->ridx = x->widx - x->lag*x->sr_ratio;
-			while (x->widx >= x->buflen)x->widx -= x->buflen;
-			while (x->widx < 0)x->widx++;
-			
-			while (x->m_dReadIdx > x->buflen - 1)
-				x->m_dReadIdx -= (double)x->buflen;
-			while (x->m_dReadIdx < 0)
-				x->m_dReadIdx += (double)x->buflen;
-			
-			//pthread_mutex_lock(&x->listen_lock);
-			LeaveCriticalSection(&x->listen_lock);
-
-
-			//pthread_mutex_unlock(&x->listen_lock);
-
+			ts = lsl_pull_sample_f(x->lsl_inlet_obj, sample_f, x->nchannels, x->lsl_pull_timeout, &ec);
 			break;
-
 		case cft_double64:
+			ts = lsl_pull_sample_d(x->lsl_inlet_obj, sample_d, x->nchannels, x->lsl_pull_timeout, &ec);
 			break;
-
 		case cft_int32:
+			ts = lsl_pull_sample_i(x->lsl_inlet_obj, sample_i, x->nchannels, x->lsl_pull_timeout, &ec);
 			break;
+		default: // cft_int16, connect_info lets nothing else through
+			ts = lsl_pull_sample_s(x->lsl_inlet_obj, sample_s, x->nchannels, x->lsl_pull_timeout, &ec);
+			break;
+		}
+		if (ec != 0 || ts == 0.0)
+			continue;
 
-
+		if (x->cnt_lsl <= x->lag_lsl)
+			x->cnt_lsl += x->sr_ratio;
+		pthread_mutex_lock(&x->listen_lock);
+		if (x->fade_pending)
+		{
+			x->fade = x->fade_len;
+			x->fade_pending = 0;
 		}
+		for (i = 0; i < x->nchannels; i++)
+		{
+			switch (type)
+			{
+			case cft_float32: x->sig_buffs[i][x->widx] = (t_sample)sample_f[i]; break;
+			case cft_double64: x->sig_buffs[i][x->widx] = (t_sample)sample_d[i]; break;
+			case cft_int32: x->sig_buffs[i][x->widx] = (t_sample)sample_i[i]; break;
+			default: x->sig_buffs[i][x->widx] = (t_sample)sample_s[i]; break;
+			}
+		}
+		x->ts_buf[x->widx++] = (t_sample)ts;
+		x->ridx = x->widx - x->lag*x->sr_ratio;
+		while (x->widx >= x->buflen)x->widx -= x->buflen;
+		while (x->widx < 0)x->widx++;
+
+		while (x->m_dReadIdx > x->buflen - 1)
+			x->m_dReadIdx -= (double)x->buflen;
+		while (x->m_dReadIdx < 0)
+			x->m_dReadIdx += (double)x->buflen;
+		pthread_mutex_unlock(&x->listen_lock);
 
 	}
 
 	t_freebytes(sample_d, sizeof(double)*x->nchannels);
 	t_freebytes(sample_f, sizeof(float)*x->nchannels);
 	t_freebytes(sample_i, sizeof(int)*x->nchannels);
-	x->connected = 0;
-	return 0;//;NULL;
+	t_freebytes(sample_s, sizeof(short)*x->nchannels);
+	return NULL;
 }
 
 
 
 // helper functions:
-void destroy_info_list(t_lsl_inlet_tilde *x){
 
-  int i;
+// the list has been filled, by the directory or by a worker
+void deliver_prop_results(t_lsl_inlet_tilde *x, char *pred, int connect){
+
+  if(x->info_list.n==0 && pred[0]=='\0')
+    post("lsl_inlet~: nothing usable in %s", x->cache->s_name);
+  else if(x->info_list.n==0 && !strcmp(pred, "true()"))
+    post("no streams available");
+  else if(x->info_list.n==0)
+    post("could not find any streams matching %s", pred);
+  else if(connect)
+    lsl_inlet_tilde_connect_by_idx(x, 0);
+  else
+    pdlsl_list_post(&x->info_list);
+}
 
-  for(i=0;i<50;i++){
-    if(x->lsl_info_list[i] != NULL){
-      lsl_destroy_streaminfo(x->lsl_info_list[i]);
-      x->lsl_info_list[i] = NULL;
-    }
+void lsl_inlet_tilde_job_poll(t_lsl_inlet_tilde *x){
+
+  t_pdlsl_job *job = x->job;
+
+  if(!pdlsl_job_done(job)){
+    clock_delay(x->job_clock, JOB_POLL);
+    return;
+  }
+  // the job is cleared before anything goes out
+  x->job = NULL;
+  pdlsl_job_collect(job, &x->info_list);
+  if(job->inlet!=NULL){
+    // the cached stream answered and its inlet is open already
+    stop_listening(x);
+    if(connect_info(x, pdlsl_list_info(&x->info_list, 0), job->inlet))x->which = 0;
+    job->inlet = NULL;
   }
-  x->lsl_info_list_cnt=0;
+  else deliver_prop_results(x, job->pred, job->connect);
+  pdlsl_job_release(job);
 }
 
-void post_info_list(t_lsl_inlet_tilde *x){
-  
+// list_by_* and resolve_by_*: every -field value pair has to match. streams
+// the registry already knows about are found right away, otherwise a worker
+// asks the network with the query compiled to a predicate
+void prop_query(t_lsl_inlet_tilde *x, int argc, t_atom *argv, int connect){
+
+  t_pdlsl_query q;
+  t_pdlsl_job *job;
+
+  if(!pdlsl_query_parse(&q, x, argc, argv))return;
+  if(x->job!=NULL){
+    post("LSL outlets cannot be listed at this time. Another query is already at work.");
+    return;
+  }
+
+  if(!pdlsl_registry_start(x))return;
+  pdlsl_list_clear(&x->info_list);
+  if(pdlsl_registry_query(&x->info_list, &q)!=0){
+    deliver_prop_results(x, q.pred, connect);
+    return;
+  }
+
+  job = pdlsl_job_new();
+  strcpy(job->pred, q.pred);
+  job->connect = connect;
+  if(start_job(x, job))
+    post("Attempting to find LSL outlets with %s on the network...", q.pred);
+}
+
+int start_job(t_lsl_inlet_tilde *x, t_pdlsl_job *job){
+
+  if(!pdlsl_job_start(job, x))return 0;
+  x->job = job;
+  clock_delay(x->job_clock, JOB_POLL);
+  return 1;
+}
+
+// -cache: connect to the stream from last time without waiting for a resolve
+void load_cache(t_lsl_inlet_tilde *x){
+
+  t_pdlsl_job *job;
+  int size;
+  char *xml = pdlsl_cache_read(x->cache, &size);
+
+  if(xml==NULL)return;
+  job = pdlsl_job_new();
+  job->xml = xml;
+  job->xml_size = size;
+  job->connect = 1;
+  if(start_job(x, job))post("lsl_inlet~: trying the stream in %s", x->cache->s_name);
+}
+
+// the registry's directory changed
+void lsl_inlet_tilde_stream_event(void *owner, t_symbol *s, t_pdlsl_entry *e){
+
+  t_lsl_inlet_tilde *x = (t_lsl_inlet_tilde *)owner;
+  t_atom at[3];
+
+  SETSYMBOL(at, e->key[PDLSL_KEY_NAME]);
+  SETSYMBOL(at+1, e->key[PDLSL_KEY_TYPE]);
+  SETSYMBOL(at+2, e->key[PDLSL_KEY_SOURCE_ID]);
+  outlet_anything(x->info_outlet, s, 3, at);
+
+  if(s==gensym("appeared"))follow_binding(x, e);
+  else if(s==gensym("disappeared") && x->bind_value!=NULL && x->stream_info!=NULL &&
+	  !strcmp(lsl_get_uid(x->stream_info), e->key[PDLSL_KEY_UID]->s_name))
+    post("lsl_inlet~: lost %s, waiting for it to come back", e->key[PDLSL_KEY_NAME]->s_name);
+}
+
+// bound streams: whatever matches the binding when it (re)appears, e.g.
+// because its outlet was restarted, is connected to right away
+void follow_binding(t_lsl_inlet_tilde *x, t_pdlsl_entry *e){
+
+  if(x->bind_value==NULL || e->key[x->bind_key]!=x->bind_value)return;
+  if(x->stream_info!=NULL && !strcmp(lsl_get_uid(x->stream_info), e->key[PDLSL_KEY_UID]->s_name))
+    return;
+  if(same_shape(x, e->info))swap_inlet(x, e->info);
+  else{
+    stop_listening(x);
+    connect_info(x, e->info, NULL);
+  }
+}
+
+// a stream with the same format, channel count and rate can go on in the
+// ring buffers and from the read position of the last one
+int same_shape(t_lsl_inlet_tilde *x, lsl_streaminfo info){
+
+  if(x->stop_!=0 || x->stream_info==NULL)return 0;
+  return lsl_get_channel_format(info)==lsl_get_channel_format(x->stream_info) &&
+    lsl_get_channel_count(info)==x->nchannels &&
+    lsl_get_nominal_srate(info)==lsl_get_nominal_srate(x->stream_info);
+}
+
+// only the liblsl inlet and the listener are replaced. the outlets go on
+// from the buffered samples and fade over to the new stream when it
+// delivers, so the gap costs the time it takes the listener to connect
+void swap_inlet(t_lsl_inlet_tilde *x, lsl_streaminfo info){
+
+  post("lsl_inlet~: switching to %s (%s)", lsl_get_name(info), lsl_get_uid(info));
+  x->stop_ = 1;
+  pthread_join(x->tid, NULL);
+  if(x->lsl_inlet_obj!=NULL)lsl_destroy_inlet(x->lsl_inlet_obj);
+  x->lsl_inlet_obj = NULL;
+  lsl_destroy_streaminfo(x->stream_info);
+  x->stream_info = lsl_copy_streaminfo(info);
+  x->fade_pending = 1;
+  x->stop_ = 0;
+  if(pthread_create(&x->tid, NULL, lsl_listen_thread, (void *)x)!=0){
+    pd_error(x, "Error launching listener thread");
+    x->stop_ = 1;
+    x->which = -1;
+    x->connected = 0;
+    lsl_destroy_streaminfo(x->stream_info);
+    x->stream_info = NULL;
+    return;
+  }
+  if(x->cache!=NULL)pdlsl_cache_write(x->cache, x->stream_info);
+  // the last stream's table (and scaling) does until this one's arrives
+  fetch_channels(x);
+}
+
+// labels, units and the int16 scaling live in the desc, which only comes
+// with the full info. a worker fetches it right after connecting and the
+// channel table is parsed from it once, the listener doesn't wait for it
+void fetch_channels(t_lsl_inlet_tilde *x){
+
+  t_pdlsl_job *job;
+
+  drop_meta_job(x);
+  if(pdlsl_channels_described(x->stream_info)){
+    got_channels(x, x->stream_info);
+    return;
+  }
+  job = pdlsl_job_new();
+  job->info = lsl_copy_streaminfo(x->stream_info);
+  if(pdlsl_job_start(job, x)){
+    x->meta_job = job;
+    clock_delay(x->meta_clock, JOB_POLL);
+  }
+  else got_channels(x, NULL);
+}
+
+// a worker still out on the network frees the job when it comes back
+void drop_meta_job(t_lsl_inlet_tilde *x){
+
+  if(x->meta_job==NULL)return;
+  clock_unset(x->meta_clock);
+  pdlsl_job_release(x->meta_job);
+  x->meta_job = NULL;
+}
+
+void lsl_inlet_tilde_meta_poll(t_lsl_inlet_tilde *x){
+
+  t_pdlsl_job *job = x->meta_job;
+  lsl_streaminfo full;
+
+  if(!pdlsl_job_done(job)){
+    clock_delay(x->meta_clock, JOB_POLL);
+    return;
+  }
+  x->meta_job = NULL;
+  full = pdlsl_job_take(job);
+  pdlsl_job_release(job);
+  if(full==NULL)post("lsl_inlet~: no metadata for %s, int16 values come out raw", lsl_get_name(x->stream_info));
+  got_channels(x, full);
+  if(full!=NULL)lsl_destroy_streaminfo(full);
+}
+
+// the labels go out of the info outlet, so the patch can see what there is
+void got_channels(t_lsl_inlet_tilde *x, lsl_streaminfo full){
+
+  t_atom *at;
   int i;
-  int cnt = (x->lsl_info_list_cnt>=50)?50:x->lsl_info_list_cnt;
-  post("----------available lsl streams------------");
-  for(i=0;i<cnt;i++){
-    post("[%d] name: %s  |  type: %s  |  source_id: %s",
-    	 i,
-    	 lsl_get_name(x->lsl_info_list[i]),
-    	 lsl_get_type(x->lsl_info_list[i]),
-    	 lsl_get_source_id(x->lsl_info_list[i]));
+
+  if(pdlsl_channels_parse(&x->chans, full, x->nchannels)!=0){
+    at = (t_atom *)t_getbytes(sizeof(t_atom) * x->chans.n);
+    for(i=0;i<x->chans.n;i++)SETSYMBOL(at+i, x->chans.label[i]);
+    outlet_anything(x->info_outlet, gensym("labels"), x->chans.n, at);
+    t_freebytes(at, sizeof(t_atom) * x->chans.n);
   }
+  resolve_selection(x);
 }
 
-int prop_resolve(t_lsl_inlet_tilde *x, int argc, t_atom *argv){
+// keeps a copy of the selection, it is resolved whenever the stream changes
+void set_selection(t_lsl_inlet_tilde *x, int argc, t_atom *argv){
 
-  t_symbol *arg;
-  int resolved_count = 0;
   int i;
-  t_atom *outv;
 
-  post("prop_resolve x: %d, argc %d, argv %d", x, argc, argv);
-  
-  for(i=0;i<50;i++){
-    if(x->lsl_info_list[i] == NULL)break;
-    else{
-      lsl_destroy_streaminfo(x->lsl_info_list[i]);
-      x->lsl_info_list[i] = NULL;
-    }
+  if(x->nsel!=0){
+    t_freebytes(x->sel, sizeof(t_atom) * x->nsel);
+    t_freebytes(x->sel_idx, sizeof(int) * x->nsel);
+    x->sel = NULL;
+    x->sel_idx = NULL;
   }
-  
-  x->lsl_info_list_cnt = 0;
-  arg = atom_getsymbolarg(0, argc, argv);
-  if(!strcmp(arg->s_name, "-name"))
-      resolved_count = lsl_resolve_byprop(x->lsl_info_list, 50, "name", atom_getsymbolarg(1,argc,argv)->s_name,0,5);
+  if(argc>x->nout){
+    post("lsl_inlet~: channels: only the first %d go to outlets", x->nout);
+    argc = x->nout;
+  }
+  x->nsel = argc;
+  x->sel_ready = 1;
+  if(argc==0)return;
+  x->sel = (t_atom *)t_getbytes(sizeof(t_atom) * argc);
+  x->sel_idx = (int *)t_getbytes(sizeof(int) * argc);
+  for(i=0;i<argc;i++){
+    x->sel[i] = argv[i];
+    x->sel_idx[i] = -1;
+  }
+}
 
-  else if(!strcmp(arg->s_name, "-type"))
-      resolved_count = lsl_resolve_byprop(x->lsl_info_list, 50, "type", atom_getsymbolarg(1,argc,argv)->s_name,0,5);
+// outlets whose labels can't be looked up yet stay silent, and so do
+// those asking for a channel that doesn't exist
+void resolve_selection(t_lsl_inlet_tilde *x){
+
+  int i, idx;
+
+  x->sel_ready = 1;
+  for(i=0;i<x->nsel;i++)
+    if(x->sel[i].a_type==A_SYMBOL && x->chans.n==0)x->sel_ready = 0;
+  if(x->sel_ready && x->stream_info!=NULL)
+    for(i=0;i<x->nsel;i++){
+      if(x->sel[i].a_type==A_FLOAT){
+	idx = (int)atom_getfloat(x->sel+i);
+	if(idx<0 || idx>=x->nchannels){
+	  pd_error(x, "lsl_inlet~: channels: %s has no channel %d", lsl_get_name(x->stream_info), idx);
+	  idx = -1;
+	}
+      }
+      else if((idx = pdlsl_channels_find(&x->chans, x->sel+i))<0)
+	pd_error(x, "lsl_inlet~: channels: %s has no channel labelled %s",
+		 lsl_get_name(x->stream_info), atom_getsymbol(x->sel+i)->s_name);
+      x->sel_idx[i] = idx;
+    }
+  update_route(x);
+}
 
-  else if(!strcmp(arg->s_name, "-source_id"))
-      resolved_count = lsl_resolve_byprop(x->lsl_info_list, 50, "source_id", atom_getsymbolarg(1,argc,argv)->s_name,0,5);
+// everything the perform routine needs per outlet, so it never looks
+// anything up. int16 outlets wait for the scaling in the desc
+void update_route(t_lsl_inlet_tilde *x){
 
-  else
-    pd_error(x, "lsl_inlet: %s: uniknown flag or argument missing", arg->s_name);
+  int i, ch;
+  int scaled = lsl_get_channel_format(x->stream_info)==cft_int16;
 
-  if(resolved_count!=0)
-      return(resolved_count);
-  else{
-    post("could not find any streams of property %s matching value %s", arg->s_name, atom_getsymbolarg(1,argc,argv)->s_name);
-    return 0;
+  for(i=0;i<x->nout;i++){
+    if(x->nsel==0)ch = (i<x->nchannels) ? i : -1;
+    else ch = (i<x->nsel && x->sel_ready) ? x->sel_idx[i] : -1;
+    if(scaled && x->chans.n==0)ch = -1;
+    x->route[i] = (ch<0) ? 0 : ch;
+    x->q_scale[i] = (ch<0) ? 0 : (scaled ? x->chans.scale[ch] : 1);
+    x->q_offset[i] = (ch<0 || !scaled) ? 0 : x->chans.offset[ch];
   }
 }
 
-// pd methods:
-void lsl_inlet_disconnect(t_lsl_inlet_tilde *x){
+void stop_listening(t_lsl_inlet_tilde *x){
   
   if(x->stop_!=1){
     post("disconnecting from %s stream %s (%s)...",
-	 lsl_get_type(x->lsl_info_list[x->which]),
-    	 lsl_get_name(x->lsl_info_list[x->which]),
-    	 lsl_get_source_id(x->lsl_info_list[x->which]));
+	 lsl_get_type(x->stream_info),
+    	 lsl_get_name(x->stream_info),
+    	 lsl_get_source_id(x->stream_info));
     x->stop_=1;
     x->which = -1;
-    // here we are forced to call the dreaded pthread_cancel
-    // because the lsl_inlet waits forever for a new sample to come in
-    // if a stream disappears before the thread exits, it will simply
-    // stick waiting for a new sample and joining the thread will
-    // halt pd in that state
-    //pthread_cancel(x->tid);
-    // however, we manage all of our resources outside of that thread, so it's cool (I think...)
-    
+    // the listener pulls with a short timeout and checks the stop flag
+    // in between, so waiting for it costs at most lsl_pull_timeout
+    pthread_join(x->tid, NULL);
+
     if(x->lsl_inlet_obj!=NULL){
       lsl_destroy_inlet(x->lsl_inlet_obj);
       x->lsl_inlet_obj=NULL;
     }
+    drop_meta_job(x);
+    pdlsl_channels_free(&x->chans);
+    lsl_destroy_streaminfo(x->stream_info);
+    x->stream_info = NULL;
     post("...disconnected");
     x->connected = 0;
     x->ready = 0;
   }
 }
 
-void lsl_inlet_connect_by_idx(t_lsl_inlet_tilde *x, t_floatarg f)
+// pd methods:
+void lsl_inlet_tilde_disconnect(t_lsl_inlet_tilde *x){
+
+  x->bind_value = NULL;
+  stop_listening(x);
+}
+
+// channels Cz Pz Oz: the outlets play these channels, in this order.
+// labels and channel numbers (from 0) can be mixed, no arguments for the
+// first nout channels
+void lsl_inlet_tilde_channels(t_lsl_inlet_tilde *x, t_symbol *s, int argc, t_atom *argv){
+
+  set_selection(x, argc, argv);
+  if(x->stream_info!=NULL)resolve_selection(x);
+}
+
+// sets everything up for info (and copies it), returns 0 if it can't.
+// in is an inlet that has been opened on info already, or NULL
+int connect_info(t_lsl_inlet_tilde *x, lsl_streaminfo info, lsl_inlet in)
 {
 
-	int ec;
-	float fL, fpLplus;
+	post("connecting to %s stream %s (%s)...",
+		lsl_get_type(info),
+		lsl_get_name(info),
+		lsl_get_source_id(info));
+
+	if (lsl_get_channel_format(info) != cft_double64)
+		if (lsl_get_channel_format(info) != cft_float32)
+			if (lsl_get_channel_format(info) != cft_int32) 
+				if (lsl_get_channel_format(info) != cft_int16)
+				{
+					pd_error(x, "requested stream has invalid channel format, only floats, doubles, 32-bit and 16-bit int data allowed");
+					if (in != NULL)
+						lsl_destroy_inlet(in);
+					return 0;
+				}
+	if (lsl_get_nominal_srate(info) == 0) 
+	{
+		pd_error(x, "requested stream has invalid nominal sampling rate, this must not be 0");
+		if (in != NULL)
+			lsl_destroy_inlet(in);
+		return 0;
+	}
+
+	// prepare the ring buffers based on the stream info
+	x->nchannels = lsl_get_channel_count(info);
+	x->longbuflen = x->nchannels * x->buflen;
+	if (x->nchannels > x->nout && x->nsel == 0)
+		post("lsl_inlet~: %s has %d channels, the first %d come out (see channels)",
+			lsl_get_name(info), x->nchannels, x->nout);
+	setup_lsl_buffers(x);
+
+	// prepare the upsampling factors based on the stream info
+	x->sr_lsl = lsl_get_nominal_srate(info);
+	x->sr_ratio = (double)x->sr_lsl / (double)x->sr_pd;
+	x->lag_lsl = x->sr_ratio*(double)x->lag;
+	x->m_dReadIdx = 0.0;
+	x->cnt_lsl = 0.0;
+	x->fade = 0;
+	x->fade_pending = 0;
 
-	if (x->lsl_info_list_cnt == 0) 
+	// the listener connects from this copy, the list may be replaced
+	// by the next listing in the meantime
+	if (x->stream_info != NULL)
+		lsl_destroy_streaminfo(x->stream_info);
+	x->stream_info = lsl_copy_streaminfo(info);
+
+	post("...connected, launcing listener thread");
+	x->lsl_inlet_obj = in;
+	x->stop_ = 0;
+	if (pthread_create(&x->tid, NULL, lsl_listen_thread, (void *)x) != 0)
+	{
+		pd_error(x, "Error launching listener thread");
+		x->stop_ = 1;
+		if (in != NULL)
+			lsl_destroy_inlet(in);
+		x->lsl_inlet_obj = NULL;
+		lsl_destroy_streaminfo(x->stream_info);
+		x->stream_info = NULL;
+		return 0;
+	}
+	if (x->cache != NULL)
+		pdlsl_cache_write(x->cache, x->stream_info);
+	resolve_selection(x);
+	fetch_channels(x);
+	return 1;
+}
+
+void lsl_inlet_tilde_connect_by_idx(t_lsl_inlet_tilde *x, t_floatarg f)
+{
+
+	if (x->info_list.n == 0) 
 	{
 		post("No lsl_info objects available. Please try to resolve available LSL outlets.");
 		return;
 	}
-	else if ((f > x->lsl_info_list_cnt) || (f < 0)) 
+	else if ((f >= x->info_list.n) || (f < 0)) 
 	{
 		post("Invalid selection from list of available outlets.");
 		return;
 	}
 	else 
 	{
+		lsl_inlet_tilde_disconnect(x);
+		if (connect_info(x, pdlsl_list_info(&x->info_list, (int)f), NULL))
+			x->which = (int)f;
+	}
+}
 
-		x->which = (int)f;
-		post("connecting to %s stream %s (%s)...",
-			lsl_get_type(x->lsl_info_list[x->which]),
-			lsl_get_name(x->lsl_info_list[x->which]),
-			lsl_get_source_id(x->lsl_info_list[x->which]));
-		//if(x->lsl_inlet_obj!=NULL)lsl_destroy_inlet(x->lsl_inlet_obj);
+// bind -uid <uid> | bind -source_id <source_id>: connects to the stream
+// now or as soon as it shows up, and again whenever it comes back.
+// -source_id survives a restart of the outlet, -uid only a lost connection
+void lsl_inlet_tilde_bind(t_lsl_inlet_tilde *x, t_symbol *s, int argc, t_atom *argv){
 
-		if (lsl_get_channel_format(x->lsl_info_list[x->which]) != cft_double64)
-			if (lsl_get_channel_format(x->lsl_info_list[x->which]) != cft_float32)
-				if (lsl_get_channel_format(x->lsl_info_list[x->which]) != cft_int32) 
-				{
-					pd_error(x, "requested stream has invalid channel format, only floats, doubles, and 32-bit int data allowed");
-					return;
-				}
-		if (lsl_get_nominal_srate(x->lsl_info_list[x->which]) == 0) 
-		{
-			pd_error(x, "requested stream has invalid nominal sampling rate, this must not be 0");
-			return;
-		}
+  t_symbol *flag = atom_getsymbolarg(0, argc, argv);
+  t_pdlsl_list found;
+  int key;
 
-		// prepare the ring buffers based on the stream info
-		x->nchannels = lsl_get_channel_count(x->lsl_info_list[x->which]);
-		x->longbuflen = x->nchannels * x->buflen;
-		//post("%d", x->nchannels);
-		if (x->nchannels > x->nout) 
-		{
-			pd_error(x, "the requested stream has more channels than are available in this pd object");
-			return;
-		}
-		setup_lsl_buffers(x);
-
-		// prepare the upsampling factors based on the stream info
-		x->sr_lsl = lsl_get_nominal_srate(x->lsl_info_list[x->which]);
-		x->sr_ratio = (double)x->sr_lsl / (double)x->sr_pd;
-		x->lag_lsl = x->sr_ratio*(double)x->lag;
-		x->m_dReadIdx = 0.0;
-		
-
-		post("...connected, launcing listener thread");
-		x->tid = 0;
-		x->tid = CreateThread(NULL, 0, lsl_listen_thread, (void *)x, 0, NULL);
-		//ec = pthread_create(&x->tid, NULL, lsl_listen_thread, (void *)x);
-		if (x->tid == 0) 
-		{
-			pd_error(x, "Error launching listener thread");
-			return;
-		}
-	}
+  if(!strcmp(flag->s_name, "-uid"))key = PDLSL_KEY_UID;
+  else if(!strcmp(flag->s_name, "-source_id"))key = PDLSL_KEY_SOURCE_ID;
+  else{
+    pd_error(x, "lsl_inlet~: bind: %s: unknown flag (must be -uid or -source_id)", flag->s_name);
+    return;
+  }
+  if(argc<2){
+    pd_error(x, "lsl_inlet~: bind: %s: argument missing", flag->s_name);
+    return;
+  }
+  if(!pdlsl_registry_start(x))return;
+  lsl_inlet_tilde_disconnect(x);
+  x->bind_key = key;
+  x->bind_value = atom_getsymbolarg(1, argc, argv);
+
+  // the newest match, if the directory already knows it
+  pdlsl_list_init(&found);
+  if(pdlsl_registry_find(&found, key, x->bind_value)!=0)
+    follow_binding(x, found.v[found.n-1]);
+  else
+    post("lsl_inlet~: waiting for %s %s to appear", flag->s_name+1, x->bind_value->s_name);
+  pdlsl_list_free(&found);
 }
 
-// this works:
-DWORD WINAPI list_all_thread(void* in){ 
-//void *list_all_thread(void *in){
-  
-  t_lsl_inlet_tilde *x = (t_lsl_inlet_tilde *)in;
-  int listed_count;
-  post("Attempting to find LSL outlets on the network...");
-  listed_count = lsl_resolve_all(x->lsl_info_list, 50, 5);
-  if(listed_count!=0){
-    x->lsl_info_list_cnt = (listed_count>50?50:listed_count);
-    post_info_list(x);
-  }
-  else post("no streams available");
-  
-  x->can_launch_resolver = 1;
-  return 0;// NULL;
+void lsl_inlet_tilde_unbind(t_lsl_inlet_tilde *x){
+
+  x->bind_value = NULL;
 }
-void lsl_inlet_list_all(t_lsl_inlet_tilde *x){
-  
-  int ec;
-  TID tid = 0;
- // pthread_t tid;
-  if(x->can_launch_resolver == 0)
-    post("LSL outlets cannot be listed at this time. Another process is already at work.");
-  else{
-    x->can_launch_resolver = 0; // weak locking
-	tid = CreateThread(NULL, 0, list_all_thread, &x, 0, NULL);
-    //ec = pthread_create(&tid, NULL, list_all_thread, (void *)x);
-    if(tid==0){
-      pd_error(x, "Error launching list all thread");
+
+// the registry is kept current in the background, so listing is only a lookup
+void lsl_inlet_tilde_list_all(t_lsl_inlet_tilde *x){
+
+  t_pdlsl_job *job;
+  int started = pdlsl_registry_start(x);
+
+  if(!started)return;
+  // a registry that has only just started hasn't heard from anybody yet,
+  // so the first listing asks the network for everything instead
+  if(started==PDLSL_STARTED_NOW){
+    if(x->job!=NULL){
+      post("LSL outlets cannot be listed at this time. Another query is already at work.");
       return;
     }
+    pdlsl_list_clear(&x->info_list);
+    job = pdlsl_job_new();
+    strcpy(job->pred, "true()");
+    if(start_job(x, job))post("Attempting to find LSL outlets on the network...");
+    return;
   }
+  pdlsl_list_clear(&x->info_list);
+  if(pdlsl_registry_find(&x->info_list, -1, NULL)!=0)pdlsl_list_post(&x->info_list);
+  else post("no streams available");
 }
 
-// but for some reason this doesn't work:
-/* void *list_by_property_thread(void *in){ */
-
-/*   t_prop_strct *y = (t_prop_strct *)in; */
-/*   int listed_count; */
-/*   post("thread x: %d, argc %d, argv %d", y->x, y->argc, y->argv); */
-/*   listed_count = prop_resolve(y->x, y->argc, y->argv); */
-/*   if(listed_count!=0){ */
-/*     y->x->lsl_info_list_cnt = (listed_count>50?50:listed_count); */
-/*     post_info_list(y->x); */
-/*   } */
- 
-/*   y->x->can_launch_resolver = 1; */
-/*   return NULL; */
-/* } */
-void lsl_inlet_list_by_property(t_lsl_inlet_tilde *x, t_symbol *s, int argc, t_atom *argv){
-
-    int listed_count;
-    //post("thread x: %d, argc %d, argv %d", y->x, y->argc, y->argv);
-  listed_count = prop_resolve(x, argc, argv);
-  if(listed_count!=0){
-    x->lsl_info_list_cnt = (listed_count>50?50:listed_count);
-    post_info_list(x);
-  }
+void lsl_inlet_tilde_list_by_property(t_lsl_inlet_tilde *x, t_symbol *s, int argc, t_atom *argv){
 
-  
+  prop_query(x, argc, argv, 0);
 }
 
-void lsl_inlet_resolve_by_property(t_lsl_inlet_tilde *x, t_symbol *s, int argc, t_atom *argv){
+void lsl_inlet_tilde_resolve_by_property(t_lsl_inlet_tilde *x, t_symbol *s, int argc, t_atom *argv){
 
-  x->lsl_info_list_cnt = 0;
-  x->lsl_info_list_cnt = prop_resolve(x, argc, argv);
-  if(x->lsl_info_list_cnt != 0)
-    lsl_inlet_connect_by_idx(x, 0);
-  
+  prop_query(x, argc, argv, 1);
+}
+
+// the same as the property methods, but with any number of conditions in mind
+void lsl_inlet_tilde_list_by_predicate(t_lsl_inlet_tilde *x, t_symbol *s, int argc, t_atom *argv){
+
+  prop_query(x, argc, argv, 0);
+}
+
+void lsl_inlet_tilde_resolve_by_predicate(t_lsl_inlet_tilde *x, t_symbol *s, int argc, t_atom *argv){
+
+  prop_query(x, argc, argv, 1);
+}
+
+// keeps a resolver of its own on the query, so only matching streams are
+// transferred, and reports matched/unmatched. no arguments stop it
+void lsl_inlet_tilde_watch_by_predicate(t_lsl_inlet_tilde *x, t_symbol *s, int argc, t_atom *argv){
+
+  t_pdlsl_query q;
+
+  if(x->watch!=NULL){
+    pdlsl_watch_free(x->watch);
+    x->watch = NULL;
+  }
+  if(argc==0)return;
+  if(!pdlsl_query_parse(&q, x, argc, argv))return;
+  x->watch = pdlsl_watch_new(q.pred, x, lsl_inlet_tilde_stream_event);
+  if(x->watch==NULL)pd_error(x, "lsl_inlet~: could not watch for %s", q.pred);
 }
 
 
@@ -467,6 +793,7 @@ t_int *lsl_inlet_tilde_perform(t_int *w)
 	t_sample* lcl_out;
 	int sample_idx = 0;
 	double dReadIdx;
+	t_sample gain, val;
 
 
 
@@ -478,17 +805,28 @@ t_int *lsl_inlet_tilde_perform(t_int *w)
 	if (x->connected == 1 && x->cnt_lsl >= x->lag_lsl)
 	{
 
-		EnterCriticalSection(&x->listen_lock);
+		pthread_mutex_lock(&x->listen_lock);
 		//post("------------------------------------------");
 		//post("tilde perform: cnt_lsl = %f, lag_lsl = %f, readIdx = %f", x->cnt_lsl, x->lag_lsl, x->m_dReadIdx);
 		dReadIdx = x->m_dReadIdx;
+		if (x->fade_len > 0 && x->fade == x->fade_len)
+			for (i = 0; i < x->nout; i++)
+				x->fade_from[i] = x->last_out[i];
 		while (n--)
 		{
+			gain = (x->fade > 0) ? 1.0 - (t_sample)x->fade / (t_sample)x->fade_len : 1.0;
 			for (i = 0; i < x->nout; i++)
 			{
 				lcl_out = (t_sample*)w[i + 2];
-				*(lcl_out + sample_idx) = spline_interpolate(x->sig_buffs[i], x->buflen, dReadIdx);//1.0;//actual output
+				// the route is resolved on pd's thread, a muted outlet plays buffer 0 at gain 0
+				val = spline_interpolate(x->sig_buffs[x->route[i]], x->buflen, dReadIdx) * x->q_scale[i]
+					+ x->q_offset[i];
+				if (x->fade > 0)
+					val = gain * val + (1.0 - gain) * x->fade_from[i];
+				*(lcl_out + sample_idx) = x->last_out[i] = val;
 			}
+			if (x->fade > 0)
+				x->fade--;
 			*(lcl_ts_out + sample_idx++) = (x->ts_buf, x->buflen, dReadIdx);//0.0;//actual output
 			dReadIdx += x->sr_ratio;
 			while (dReadIdx > x->buflen - 1)
@@ -499,7 +837,9 @@ t_int *lsl_inlet_tilde_perform(t_int *w)
 
 
 		}
-		LeaveCriticalSection(&x->listen_lock);
+		// the read position is part of the resampler's state
+		x->m_dReadIdx = dReadIdx;
+		pthread_mutex_unlock(&x->listen_lock);
 
 	}
 	return w + x->nout + 4;
@@ -612,7 +952,7 @@ void flush_lsl_buffers(t_lsl_inlet_tilde *x)
 
 	int i, j;
 	if (x->sig_buffs != 0)
-		for (i = 0; i < x->nout; i++)
+		for (i = 0; i < x->nbuffs; i++)
 			memset(x->sig_buffs[i], 0.0, x->buflen * sizeof(t_sample));
 	/* for(i=0;i<x->buflen*x->nchannels;i++) */
 	/*   x->sig_buf[i] =  0.0; */
@@ -629,17 +969,17 @@ void free_lsl_buffers(t_lsl_inlet_tilde *x)
 {
 
 	int i;
-	post("in the free method");
 	if (x->sig_buffs != 0) 
 	{
-		post("inside sig_buffs");
-		for (i = 0; i < x->nout; i++)
+		for (i = 0; i < x->nbuffs; i++)
 			if (x->sig_buffs[i] != 0)
 				t_freebytes(x->sig_buffs[i], x->buflen*sizeof(float));
-		t_freebytes(x->sig_buffs, x->nout * sizeof(t_sample*));
+		t_freebytes(x->sig_buffs, x->nbuffs * sizeof(t_sample*));
+		x->sig_buffs = 0;
 	}
 	if (x->ts_buf != 0)
 		t_freebytes(x->ts_buf, x->buflen * sizeof(float));
+	x->ts_buf = 0;
 
 }
 
@@ -647,12 +987,13 @@ void setup_lsl_buffers(t_lsl_inlet_tilde *x)
 {
 
 	int i;
-	post("%f", x->sig_buffs);
 	if (x->sig_buffs != 0)free_lsl_buffers(x);
 
+	// every channel is buffered, the outlets play whichever are routed to them
+	x->nbuffs = (x->nchannels > x->nout) ? x->nchannels : x->nout;
 	x->sig_buffs = (t_sample **)t_getbytes(0);
-	x->sig_buffs = (t_sample **)t_resizebytes(x->sig_buffs, 0, sizeof(t_sample*) * x->nout);
-	for (i = 0; i < x->nout; i++)
+	x->sig_buffs = (t_sample **)t_resizebytes(x->sig_buffs, 0, sizeof(t_sample*) * x->nbuffs);
+	for (i = 0; i < x->nbuffs; i++)
 	{
 		x->sig_buffs[i] = (t_sample *)t_getbytes(0);
 		x->sig_buffs[i] = (t_sample *)t_resizebytes(x->sig_buffs[i], 0, sizeof(float) * x->buflen);
@@ -667,6 +1008,8 @@ void *lsl_inlet_tilde_new(t_symbol *s, int argc, t_atom *argv)
 {
 
 	int i, lcl_nout;
+	int sel_argc = 0;
+	t_atom *sel_argv = NULL;
 	t_symbol *firstarg;
 	t_lsl_inlet_tilde *x = (t_lsl_inlet_tilde *)pd_new(lsl_inlet_tilde_class);
 
@@ -682,6 +1025,15 @@ void *lsl_inlet_tilde_new(t_symbol *s, int argc, t_atom *argv)
 	x->sr_pd = sys_getsr();
 	x->sr_ratio = 1.0;
 	x->lag_lsl = (double)x->lag;
+	x->lsl_pull_timeout = 0.05;
+	x->cache = NULL;
+	x->fade_len = 0.01 * x->sr_pd;
+	x->fade = 0;
+	x->fade_pending = 0;
+	x->sel = NULL;
+	x->sel_idx = NULL;
+	x->nsel = 0;
+	x->sel_ready = 1;
 
 	// parse creation args
 	while (argc > 0) {
@@ -707,6 +1059,33 @@ void *lsl_inlet_tilde_new(t_symbol *s, int argc, t_atom *argv)
 			}
 		}
 
+		else if (!strcmp(firstarg->s_name, "-cache") && argc > 1) 
+		{
+			x->cache = pdlsl_cache_path(atom_getsymbolarg(1, argc, argv)->s_name);
+			argc -= 2;
+			argv += 2;
+		}
+
+		else if (!strcmp(firstarg->s_name, "-channels")) 
+		{
+			// everything up to the next flag, once -nout is known
+			for (i = 1; i < argc && !(argv[i].a_type == A_SYMBOL && argv[i].a_w.w_symbol->s_name[0] == '-'); i++);
+			sel_argc = i - 1;
+			sel_argv = argv + 1;
+			argc -= i;
+			argv += i;
+		}
+
+		else if (!strcmp(firstarg->s_name, "-crossfade")) 
+		{
+			// ms, how long a bound stream that came back takes to fade in
+			x->fade_len = atom_getfloatarg(1, argc, argv) * 0.001 * x->sr_pd;
+			if (x->fade_len < 0)
+				x->fade_len = 0;
+			argc -= 2;
+			argv += 2;
+		}
+
 		else if (!strcmp(firstarg->s_name, "-nout")) 
 		{
 			lcl_nout = (atom_getfloatarg(1, argc, argv));
@@ -737,6 +1116,7 @@ void *lsl_inlet_tilde_new(t_symbol *s, int argc, t_atom *argv)
 	//for (i = 0; i < x->nout; i++)
 		//x->sig_buffs[i] = 0;
 	x->ts_buf = 0;
+	x->nbuffs = 0;
 	x->nchannels = 0; // this gets set on inlet creation
 
 	// setup the memory
@@ -748,20 +1128,39 @@ void *lsl_inlet_tilde_new(t_symbol *s, int argc, t_atom *argv)
 	x->sig_outlets = (t_outlet **)t_resizebytes(x->lcl_outs, 0, sizeof(t_sample *) * x->nout);
 	for (i = 0; i < x->nout; i++) x->sig_outlets[i] = outlet_new(&x->x_obj, &s_signal);
 	x->ts_outlet = outlet_new(&x->x_obj, &s_signal);
+	x->info_outlet = outlet_new(&x->x_obj, 0);
+
+	x->route = (int *)t_getbytes(sizeof(int) * x->nout);
+	x->q_scale = (float *)t_getbytes(sizeof(float) * x->nout);
+	x->q_offset = (float *)t_getbytes(sizeof(float) * x->nout);
+	x->fade_from = (t_sample *)t_getbytes(sizeof(t_sample) * x->nout);
+	x->last_out = (t_sample *)t_getbytes(sizeof(t_sample) * x->nout);
 
 	x->which = -1;
-	x->can_launch_resolver = 1;
 
 
-	for (i = 0; i < 50; i++)
-		x->lsl_info_list[i] = NULL;
-	x->lsl_info_list_cnt = 0;
+	pdlsl_list_init(&x->info_list);
+	x->stream_info = NULL;
+	x->bind_key = PDLSL_KEY_SOURCE_ID;
+	x->bind_value = NULL;
+
+	// the first object in starts the registry's resolver
+	pdlsl_registry_acquire(x, lsl_inlet_tilde_stream_event);
+	x->job = NULL;
+	x->watch = NULL;
+	x->job_clock = clock_new(x, (t_method)lsl_inlet_tilde_job_poll);
+	x->meta_job = NULL;
+	x->meta_clock = clock_new(x, (t_method)lsl_inlet_tilde_meta_poll);
+	pdlsl_channels_init(&x->chans);
+	set_selection(x, sel_argc, sel_argv);
 	//x->lsl_inlet_obj = NULL;
 
-	//x->listen_lock = PTHREAD_MUTEX_INITIALIZER;
-	InitializeCriticalSection(&x->listen_lock);
+	pthread_mutex_init(&x->listen_lock, NULL);
 	x->stop_ = 1;
 
+	if (x->cache != NULL)
+		load_cache(x);
+
 	return x;
 
 }
@@ -772,10 +1171,13 @@ void lsl_inlet_tilde_free(t_lsl_inlet_tilde *x)
 {
 
 	int i;
-	DeleteCriticalSection(&x->listen_lock);
 
-	destroy_info_list(x);
-	lsl_inlet_disconnect(x);
+	lsl_inlet_tilde_disconnect(x);
+	pthread_mutex_destroy(&x->listen_lock);
+	if (x->watch != NULL)
+		pdlsl_watch_free(x->watch);
+	pdlsl_list_free(&x->info_list);
+	pdlsl_registry_release(x);
 	if (x->lsl_inlet_obj != NULL)lsl_destroy_inlet(x->lsl_inlet_obj);
 
 	if (x->lcl_outs != 0)
@@ -785,6 +1187,20 @@ void lsl_inlet_tilde_free(t_lsl_inlet_tilde *x)
 		t_freebytes(x->sig_outlets, sizeof(t_outlet *)*x->nout);
 
 	free_lsl_buffers(x);
+	t_freebytes(x->route, sizeof(int) * x->nout);
+	t_freebytes(x->q_scale, sizeof(float) * x->nout);
+	t_freebytes(x->q_offset, sizeof(float) * x->nout);
+	t_freebytes(x->fade_from, sizeof(t_sample) * x->nout);
+	t_freebytes(x->last_out, sizeof(t_sample) * x->nout);
+
+	// a worker still out on the network frees the job when it comes back
+	clock_free(x->job_clock);
+	if (x->job != NULL)
+		pdlsl_job_release(x->job);
+	clock_free(x->meta_clock);
+	set_selection(x, 0, NULL);
+	if (x->stream_info != NULL)
+		lsl_destroy_streaminfo(x->stream_info);
 
 }
 
@@ -800,33 +1216,68 @@ void lsl_inlet_tilde_setup(void)
 		0);
 
 	class_addmethod(lsl_inlet_tilde_class,
-		(t_method)lsl_inlet_disconnect,
+		(t_method)lsl_inlet_tilde_disconnect,
 		gensym("disconnect"),
 		0);
 
 	class_addmethod(lsl_inlet_tilde_class,
-		(t_method)lsl_inlet_connect_by_idx,
+		(t_method)lsl_inlet_tilde_connect_by_idx,
 		gensym("connect_by_idx"),
 		A_DEFFLOAT,
 		A_NULL);
 
 	class_addmethod(lsl_inlet_tilde_class,
-		(t_method)lsl_inlet_list_all,
+		(t_method)lsl_inlet_tilde_bind,
+		gensym("bind"),
+		A_GIMME,
+		A_NULL);
+
+	class_addmethod(lsl_inlet_tilde_class,
+		(t_method)lsl_inlet_tilde_unbind,
+		gensym("unbind"),
+		A_NULL);
+
+	class_addmethod(lsl_inlet_tilde_class,
+		(t_method)lsl_inlet_tilde_list_all,
 		gensym("list_all"),
 		A_NULL);
 
 	class_addmethod(lsl_inlet_tilde_class,
-		(t_method)lsl_inlet_list_by_property,
+		(t_method)lsl_inlet_tilde_list_by_property,
 		gensym("list_by_property"),
 		A_GIMME,
 		A_NULL);
 
 	class_addmethod(lsl_inlet_tilde_class,
-		(t_method)lsl_inlet_resolve_by_property,
+		(t_method)lsl_inlet_tilde_resolve_by_property,
 		gensym("resolve_by_property"),
 		A_GIMME,
 		A_NULL);
 
+	class_addmethod(lsl_inlet_tilde_class,
+		(t_method)lsl_inlet_tilde_list_by_predicate,
+		gensym("list_by_predicate"),
+		A_GIMME,
+		A_NULL);
+
+	class_addmethod(lsl_inlet_tilde_class,
+		(t_method)lsl_inlet_tilde_resolve_by_predicate,
+		gensym("resolve_by_predicate"),
+		A_GIMME,
+		A_NULL);
+
+	class_addmethod(lsl_inlet_tilde_class,
+		(t_method)lsl_inlet_tilde_watch_by_predicate,
+		gensym("watch_by_predicate"),
+		A_GIMME,
+		A_NULL);
+
+	class_addmethod(lsl_inlet_tilde_class,
+		(t_method)lsl_inlet_tilde_channels,
+		gensym("channels"),
+		A_GIMME,
+		A_NULL);
+
 	class_addmethod(lsl_inlet_tilde_class,
 		(t_method)lsl_inlet_tilde_dsp, gensym("dsp"), A_NULL);
 
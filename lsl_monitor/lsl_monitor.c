@@ -0,0 +1,496 @@
+/*************** lsl_monitor ***************/
+/* Written by David Medine on behalf of    */
+/* Brain Products                          */
+/* 15/5/2017                               */
+/* Released under the GPL                  */
+/* This software is free and open source   */
+/*******************************************/
+
+
+#include "m_pd.h"
+#include "pdlsl_lib.h"
+#include "pdlsl_registry.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "pthread.h"
+
+#ifdef _WIN32
+#include "windows.h"
+#define sleep_ms(ms) Sleep(ms)
+#else
+#include <unistd.h>
+#define sleep_ms(ms) usleep((ms)*1000)
+#endif
+
+#define MAX_STREAMS  64              // per monitor, more than any lab runs
+#define CHUNKLEN     256             // samples pulled at a time per stream
+#define PASS_SLEEP   10              // ms the measuring thread rests between passes
+#define OPEN_WAIT    1.0             // s a new stream gets to accept the connection
+#define TC_WAIT      0.5             // s for a time correction estimate
+#define GAP_FACTOR   1.5             // sample intervals this much over nominal count as a gap
+
+// a slot is handed back and forth between pd's thread and the measuring
+// thread: pd fills a FREE one and makes it NEW, the thread opens it and
+// makes it ACTIVE, pd marks it GONE and the thread closes it and makes it
+// FREE again. only the owner of a state touches the fields below it
+#define SLOT_FREE    0
+#define SLOT_NEW     1
+#define SLOT_ACTIVE  2
+#define SLOT_GONE    3
+
+typedef struct _monitor_slot{
+  int             state;            // under the monitor's lock
+
+  // pd's, set before the slot becomes NEW
+  t_symbol        *name;
+  t_symbol        *uid;
+  lsl_streaminfo  info;             // the thread's from NEW on
+  double          nominal;
+  int             nchannels;
+  int             strings;
+
+  // the thread's
+  lsl_inlet       inlet;
+  double          *d_chunk;
+  char            **str_chunk;
+  double          ts_chunk[CHUNKLEN];
+  double          last_ts;          // of the latest sample, 0 before the first
+  double          win_start;        // local time the window opened
+  int             win_n;            // sample intervals in this window
+  double          sum_dt;
+  double          sum_dt2;
+  int             gaps;             // since the monitor started (or reset)
+  int             dropped;          // samples missing in those gaps, by the nominal rate
+
+  // the summary of the last window, copied out on pd's thread under the lock
+  int             fresh;
+  double          rep_rate;         // effective rate, by the timestamps
+  double          rep_tc;           // time correction in ms
+  double          rep_jitter;       // std. deviation of the sample interval in ms
+  int             rep_gaps;
+  int             rep_dropped;
+}t_monitor_slot;
+
+// pd boilerplate:
+static t_class *lsl_monitor_class;
+
+typedef struct _lsl_monitor{
+
+  t_object        x_obj;
+
+  t_outlet        *report_outlet;   // <name> <rate> <nominal> <tc> <jitter> <gaps> <dropped>
+  t_outlet        *info_outlet;     // monitoring/lost and the directory's appeared/disappeared
+
+  t_monitor_slot  slots[MAX_STREAMS];
+  int             watching;         // a query is set, streams that appear are picked up
+  t_pdlsl_query   query;
+  double          interval;         // ms between summaries
+  int             reset;            // ask the thread to zero the gap counts
+  t_clock         *report_clock;
+
+  pthread_mutex_t lock;
+  pthread_t       tid;
+  int             running;
+  int             stop_;
+
+}t_lsl_monitor;
+
+// measuring thread function declaration:
+static void *lsl_monitor_thread(void *in);
+
+// helper function declarations:
+static void open_slot(t_lsl_monitor *x, t_monitor_slot *sl);
+static void close_slot(t_monitor_slot *sl);
+static void measure_slot(t_lsl_monitor *x, t_monitor_slot *sl, double now, int reset);
+static int find_slot(t_lsl_monitor *x, t_symbol *uid);
+static void add_stream(t_lsl_monitor *x, t_pdlsl_entry *e);
+static void remove_slot(t_lsl_monitor *x, int i);
+static int start_thread(t_lsl_monitor *x);
+static void lsl_monitor_report(t_lsl_monitor *x);
+static void lsl_monitor_stream_event(void *owner, t_symbol *s, t_pdlsl_entry *e);
+
+// measuring thread functions:
+// the thread never touches pd. it owns every inlet, so the blocking calls
+// (opening a stream, the first time correction) only ever hold it up
+
+// a small buffer is all it needs, the samples are thrown away right after
+static void open_slot(t_lsl_monitor *x, t_monitor_slot *sl){
+
+  int ec = lsl_no_error;
+
+  sl->inlet = lsl_create_inlet(sl->info, 1, CHUNKLEN, 1);
+  if(sl->inlet!=NULL)lsl_open_stream(sl->inlet, OPEN_WAIT, &ec);
+  if(sl->strings)
+    sl->str_chunk = (char **)t_getbytes(sizeof(char *) * CHUNKLEN * sl->nchannels);
+  else
+    sl->d_chunk = (double *)t_getbytes(sizeof(double) * CHUNKLEN * sl->nchannels);
+  sl->last_ts = 0;
+  sl->win_start = lsl_local_clock();
+  sl->win_n = 0;
+  sl->sum_dt = sl->sum_dt2 = 0;
+  sl->gaps = sl->dropped = 0;
+  sl->rep_tc = 0;
+}
+
+static void close_slot(t_monitor_slot *sl){
+
+  if(sl->inlet!=NULL)lsl_destroy_inlet(sl->inlet);
+  sl->inlet = NULL;
+  if(sl->str_chunk!=NULL)
+    t_freebytes(sl->str_chunk, sizeof(char *) * CHUNKLEN * sl->nchannels);
+  if(sl->d_chunk!=NULL)
+    t_freebytes(sl->d_chunk, sizeof(double) * CHUNKLEN * sl->nchannels);
+  sl->str_chunk = NULL;
+  sl->d_chunk = NULL;
+  lsl_destroy_streaminfo(sl->info);
+  sl->info = NULL;
+}
+
+// everything that is waiting, then the window's summary if it is over
+static void measure_slot(t_lsl_monitor *x, t_monitor_slot *sl, double now, int reset){
+
+  int ec, i, n, missing;
+  double dt, mean, var, tc;
+
+  if(sl->inlet==NULL)return;
+  if(reset)sl->gaps = sl->dropped = 0;
+  do{
+    ec = lsl_no_error;
+    if(sl->strings){
+      n = lsl_pull_chunk_str(sl->inlet, sl->str_chunk, sl->ts_chunk,
+			     CHUNKLEN * sl->nchannels, CHUNKLEN, 0.0, &ec);
+      for(i=0;i<n;i++)lsl_destroy_string(sl->str_chunk[i]);
+    }
+    else
+      n = lsl_pull_chunk_d(sl->inlet, sl->d_chunk, sl->ts_chunk,
+			   CHUNKLEN * sl->nchannels, CHUNKLEN, 0.0, &ec);
+    if(ec!=lsl_no_error)n = 0;
+    n /= sl->nchannels;
+    for(i=0;i<n;i++){
+      if(sl->last_ts!=0){
+	dt = sl->ts_chunk[i] - sl->last_ts;
+	sl->sum_dt += dt;
+	sl->sum_dt2 += dt * dt;
+	sl->win_n++;
+	if(sl->nominal!=0 && dt * sl->nominal > GAP_FACTOR){
+	  missing = (int)(dt * sl->nominal + 0.5) - 1;
+	  sl->gaps++;
+	  sl->dropped += (missing>0) ? missing : 0;
+	}
+      }
+      sl->last_ts = sl->ts_chunk[i];
+    }
+  }while(n==CHUNKLEN && x->stop_==0);
+
+  if((now - sl->win_start) * 1000.0 < x->interval)return;
+
+  // liblsl keeps the estimate current, only the first call goes out
+  ec = lsl_no_error;
+  tc = lsl_time_correction(sl->inlet, TC_WAIT, &ec);
+  mean = (sl->win_n!=0) ? sl->sum_dt / sl->win_n : 0;
+  var = (sl->win_n!=0) ? sl->sum_dt2 / sl->win_n - mean * mean : 0;
+
+  pthread_mutex_lock(&x->lock);
+  sl->rep_rate = (mean>0) ? 1.0 / mean : 0;
+  if(ec==lsl_no_error)sl->rep_tc = tc * 1000.0;
+  sl->rep_jitter = (var>0) ? sqrt(var) * 1000.0 : 0;
+  sl->rep_gaps = sl->gaps;
+  sl->rep_dropped = sl->dropped;
+  sl->fresh = 1;
+  pthread_mutex_unlock(&x->lock);
+
+  sl->win_start = now;
+  sl->win_n = 0;
+  sl->sum_dt = sl->sum_dt2 = 0;
+}
+
+static void *lsl_monitor_thread(void *in){
+
+  t_lsl_monitor *x = (t_lsl_monitor *)in;
+  t_monitor_slot *sl;
+  int i, state, reset;
+
+  while(x->stop_==0){
+    reset = x->reset;
+    x->reset = 0;
+    for(i=0;i<MAX_STREAMS && x->stop_==0;i++){
+      sl = x->slots + i;
+      pthread_mutex_lock(&x->lock);
+      state = sl->state;
+      pthread_mutex_unlock(&x->lock);
+
+      if(state==SLOT_NEW){
+	open_slot(x, sl);
+	state = SLOT_ACTIVE;
+      }
+      else if(state==SLOT_GONE){
+	close_slot(sl);
+	state = SLOT_FREE;
+      }
+      else if(state==SLOT_ACTIVE)measure_slot(x, sl, lsl_local_clock(), reset);
+      else continue;
+
+      // pd may have given the slot up in the meantime, it is closed next pass
+      pthread_mutex_lock(&x->lock);
+      if(state==SLOT_FREE || sl->state!=SLOT_GONE)sl->state = state;
+      pthread_mutex_unlock(&x->lock);
+    }
+    sleep_ms(PASS_SLEEP);
+  }
+
+  // the monitor is going away, nobody else will close them
+  for(i=0;i<MAX_STREAMS;i++)
+    if(x->slots[i].state!=SLOT_FREE && x->slots[i].info!=NULL)close_slot(x->slots + i);
+  return NULL;
+}
+
+// helper functions:
+
+// the pd side only ever looks at the summaries
+static void lsl_monitor_report(t_lsl_monitor *x){
+
+  t_monitor_slot *sl;
+  t_atom at[6];
+  t_symbol *name;
+  int i, fresh;
+
+  for(i=0;i<MAX_STREAMS;i++){
+    sl = x->slots + i;
+    pthread_mutex_lock(&x->lock);
+    fresh = (sl->state==SLOT_ACTIVE && sl->fresh);
+    if(fresh){
+      name = sl->name;
+      SETFLOAT(at, (t_float)sl->rep_rate);
+      SETFLOAT(at+1, (t_float)sl->nominal);
+      SETFLOAT(at+2, (t_float)sl->rep_tc);
+      SETFLOAT(at+3, (t_float)sl->rep_jitter);
+      SETFLOAT(at+4, (t_float)sl->rep_gaps);
+      SETFLOAT(at+5, (t_float)sl->rep_dropped);
+      sl->fresh = 0;
+    }
+    pthread_mutex_unlock(&x->lock);
+    if(fresh)outlet_anything(x->report_outlet, name, 6, at);
+  }
+  clock_delay(x->report_clock, x->interval);
+}
+
+static int find_slot(t_lsl_monitor *x, t_symbol *uid){
+
+  int i;
+
+  for(i=0;i<MAX_STREAMS;i++)
+    if(x->slots[i].uid==uid &&
+       (x->slots[i].state==SLOT_NEW || x->slots[i].state==SLOT_ACTIVE))return i;
+  return -1;
+}
+
+static void add_stream(t_lsl_monitor *x, t_pdlsl_entry *e){
+
+  t_monitor_slot *sl;
+  t_atom at;
+  int i;
+
+  if(find_slot(x, e->key[PDLSL_KEY_UID])>=0)return;
+  pthread_mutex_lock(&x->lock);
+  for(i=0;i<MAX_STREAMS && x->slots[i].state!=SLOT_FREE;i++);
+  pthread_mutex_unlock(&x->lock);
+  if(i==MAX_STREAMS){
+    pd_error(x, "lsl_monitor: can't watch more than %d streams, %s is left out",
+	     MAX_STREAMS, e->key[PDLSL_KEY_NAME]->s_name);
+    return;
+  }
+  if(!start_thread(x))return;
+
+  // a FREE slot is pd's until it is NEW
+  sl = x->slots + i;
+  sl->name = e->key[PDLSL_KEY_NAME];
+  sl->uid = e->key[PDLSL_KEY_UID];
+  sl->info = lsl_copy_streaminfo(e->info);
+  sl->nominal = lsl_get_nominal_srate(e->info);
+  sl->nchannels = lsl_get_channel_count(e->info);
+  if(sl->nchannels<1)sl->nchannels = 1;
+  sl->strings = (lsl_get_channel_format(e->info)==cft_string);
+  sl->fresh = 0;
+  pthread_mutex_lock(&x->lock);
+  sl->state = SLOT_NEW;
+  pthread_mutex_unlock(&x->lock);
+
+  SETSYMBOL(&at, sl->name);
+  outlet_anything(x->info_outlet, gensym("monitoring"), 1, &at);
+}
+
+static void remove_slot(t_lsl_monitor *x, int i){
+
+  pthread_mutex_lock(&x->lock);
+  x->slots[i].state = SLOT_GONE;
+  pthread_mutex_unlock(&x->lock);
+}
+
+static int start_thread(t_lsl_monitor *x){
+
+  if(x->running)return 1;
+  x->stop_ = 0;
+  if(pthread_create(&x->tid, NULL, lsl_monitor_thread, (void *)x)!=0){
+    pd_error(x, "lsl_monitor: error launching measuring thread");
+    x->stop_ = 1;
+    return 0;
+  }
+  x->running = 1;
+  clock_delay(x->report_clock, x->interval);
+  return 1;
+}
+
+// the registry's directory changed
+static void lsl_monitor_stream_event(void *owner, t_symbol *s, t_pdlsl_entry *e){
+
+  t_lsl_monitor *x = (t_lsl_monitor *)owner;
+  t_atom at[3];
+  int i;
+
+  SETSYMBOL(at, e->key[PDLSL_KEY_NAME]);
+  SETSYMBOL(at+1, e->key[PDLSL_KEY_TYPE]);
+  SETSYMBOL(at+2, e->key[PDLSL_KEY_SOURCE_ID]);
+  outlet_anything(x->info_outlet, s, 3, at);
+
+  if(s==gensym("appeared")){
+    if(x->watching && pdlsl_query_match(&x->query, e->info))add_stream(x, e);
+  }
+  else if(s==gensym("disappeared") && (i = find_slot(x, e->key[PDLSL_KEY_UID]))>=0){
+    remove_slot(x, i);
+    outlet_anything(x->info_outlet, gensym("lost"), 1, at);
+  }
+}
+
+// pd methods:
+
+// monitor -<field> <value> ...: every stream that matches, now and when
+// it shows up. without arguments every stream on the network
+void lsl_monitor_monitor(t_lsl_monitor *x, t_symbol *s, int argc, t_atom *argv){
+
+  t_pdlsl_list found;
+  t_pdlsl_query q;
+  int i, started;
+
+  // an empty query matches everything
+  q.n = 0;
+  strcpy(q.pred, "true()");
+  if(argc>0 && !pdlsl_query_parse(&q, x, argc, argv))return;
+  if(!(started = pdlsl_registry_start(x)))return;
+  x->query = q;
+  x->watching = 1;
+  // the streams of the last query that don't match this one are let go
+  for(i=0;i<MAX_STREAMS;i++)
+    if((x->slots[i].state==SLOT_NEW || x->slots[i].state==SLOT_ACTIVE) &&
+       !pdlsl_query_match(&q, x->slots[i].info))
+      remove_slot(x, i);
+
+  pdlsl_list_init(&found);
+  pdlsl_registry_query(&found, &q);
+  for(i=0;i<found.n;i++)add_stream(x, found.v[i]);
+  pdlsl_list_free(&found);
+  // a registry that has only just started finds them as they appear
+  if(started==PDLSL_STARTED_NOW)post("lsl_monitor: waiting for streams to appear");
+}
+
+void lsl_monitor_stop(t_lsl_monitor *x){
+
+  int i;
+
+  x->watching = 0;
+  for(i=0;i<MAX_STREAMS;i++)
+    if(x->slots[i].state==SLOT_NEW || x->slots[i].state==SLOT_ACTIVE)remove_slot(x, i);
+}
+
+void lsl_monitor_interval(t_lsl_monitor *x, t_floatarg f){
+
+  x->interval = (f<100)?100:f;
+}
+
+// the thread zeroes the gap and drop counts on its next pass
+void lsl_monitor_reset(t_lsl_monitor *x){
+
+  x->reset = 1;
+}
+
+void *lsl_monitor_new(t_symbol *s, int argc, t_atom *argv){
+
+  t_lsl_monitor *x = (t_lsl_monitor *)pd_new(lsl_monitor_class);
+  int i;
+
+  x->report_outlet = outlet_new(&x->x_obj, 0);
+  x->info_outlet = outlet_new(&x->x_obj, 0);
+
+  for(i=0;i<MAX_STREAMS;i++){
+    x->slots[i].state = SLOT_FREE;
+    x->slots[i].uid = NULL;
+    x->slots[i].info = NULL;
+    x->slots[i].inlet = NULL;
+    x->slots[i].d_chunk = NULL;
+    x->slots[i].str_chunk = NULL;
+  }
+  x->watching = 0;
+  x->interval = 1000;
+  x->reset = 0;
+  x->report_clock = clock_new(x, (t_method)lsl_monitor_report);
+  pthread_mutex_init(&x->lock, NULL);
+  x->running = 0;
+  x->stop_ = 1;
+
+  // -interval <ms> first, anything else is the query
+  if(argc>1 && !strcmp(atom_getsymbolarg(0, argc, argv)->s_name, "-interval")){
+    lsl_monitor_interval(x, atom_getfloatarg(1, argc, argv));
+    argc-=2, argv+=2;
+  }
+  pdlsl_registry_acquire(x, lsl_monitor_stream_event);
+  // nothing to monitor, nothing loaded until asked
+  if(argc>0)lsl_monitor_monitor(x, gensym("monitor"), argc, argv);
+
+  return x;
+}
+
+void lsl_monitor_free(t_lsl_monitor *x){
+
+  clock_free(x->report_clock);
+  // the thread closes whatever is still open on its way out
+  if(x->running){
+    x->stop_ = 1;
+    pthread_join(x->tid, NULL);
+  }
+  pdlsl_registry_release(x);
+  pthread_mutex_destroy(&x->lock);
+}
+
+void lsl_monitor_setup(void){
+
+  lsl_monitor_class = class_new(gensym("lsl_monitor"),
+				(t_newmethod)lsl_monitor_new,
+				(t_method)lsl_monitor_free,
+				sizeof(t_lsl_monitor),
+				0,
+				A_GIMME,
+				0);
+
+  class_addmethod(lsl_monitor_class,
+		  (t_method)lsl_monitor_monitor,
+		  gensym("monitor"),
+		  A_GIMME,
+		  0);
+
+  class_addmethod(lsl_monitor_class,
+		  (t_method)lsl_monitor_stop,
+		  gensym("stop"),
+		  0);
+
+  class_addmethod(lsl_monitor_class,
+		  (t_method)lsl_monitor_interval,
+		  gensym("interval"),
+		  A_FLOAT,
+		  0);
+
+  class_addmethod(lsl_monitor_class,
+		  (t_method)lsl_monitor_reset,
+		  gensym("reset"),
+		  0);
+}
@@ -8,17 +8,36 @@
 
 
 #include "m_pd.h"
-#include "lsl_c.h"
+#include "pdlsl_lib.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include "pthread.h"
 
 #ifdef _WIN32
 #include "windows.h"
+#define memory_barrier() MemoryBarrier()
+#define sleep_ms(ms) Sleep(ms)
 #else
 #include <unistd.h>
+#define memory_barrier() __sync_synchronize()
+#define sleep_ms(ms) usleep((ms)*1000)
 #endif
 
+#define CONSUMER_POLL 200      // ms between checks for consumers
+#define STR_FIELD 32           // room for the text of one float in a string stream
+#define TRIGGER_RINGLEN 256    // markers in flight between the perform routine and the watcher
+
+// what the signal inlet reacts to (-trigger)
+#define TRIGGER_OFF     0
+#define TRIGGER_EDGE    1      // the first sample above 0 after one at or below it
+#define TRIGGER_NONZERO 2      // every sample that isn't 0
+
+typedef struct _trigger_event{
+  double      t;               // lsl time of the sample
+  t_sample    val;
+}t_trigger_event;
+
 // pd boilerplate:
 static t_class *lsl_outlet_class;
 
@@ -26,16 +45,364 @@ typedef struct _lsl_outlet{
 
   t_object    x_obj;
   t_outlet    *f_outlet;
+  t_outlet    *consumers_outlet;
  
   lsl_outlet              lsl_outlet_obj;      // instantiation of the outlet class           
   lsl_channel_format_t    cft;
+  int                     nchannels;
   
   float                   outlet_established;
+
+  // samples of the stream, packed by push in the outlet's format. with
+  // chunk_size > 1 they pile up here and go out in one lsl_push_chunk
+  char                    *push_buf;           // chunk_size * nchannels of whatever type cft is
+  char                    *str_store;          // text of numbers sent to string streams
+  double                  *ts_buf;             // stamp of every buffered sample
+  int                     chunk_size;          // samples per push, 1 sends every sample right away
+  int                     nbuffered;
+  double                  flush_interval;      // ms after the first buffered sample until it all goes out, 0 never
+  t_clock                 *flush_clock;
+
+  // nobody listening means nothing to convert or push. lsl_have_consumers
+  // is asked from a watcher thread, pd only looks at the flag
+  volatile int            consumers;
+  int                     consumers_reported;  // last value sent out the right outlet
+  t_clock                 *consumers_clock;
+  pthread_t               tid;
+  int                     stop_;
+  int                     watching;
+
+  // markers found by the perform routine, stamped to the sample and
+  // handed to the watcher thread which pushes them
+  int                     trigger;
+  t_trigger_event         trig_ring[TRIGGER_RINGLEN];
+  volatile int            trig_widx;           // perform only
+  volatile int            trig_ridx;           // watcher only
+  unsigned long           trig_dropped;        // ring was full (perform only)
+  unsigned long           trig_reported;
+  t_sample                trig_prev;           // last sample of the previous block
+  t_float                 sr;
+  char                    *trig_buf;           // TRIGGER_RINGLEN samples in the outlet's format
+  char                    *trig_str;           // text of the markers for string streams
+  double                  *trig_ts;
+
+  // mapping of pd's logical time onto the lsl clock for timestamping
+  t_clock                 *sync_clock;         // periodically refines clk_offset
+  double                  clk_anchor;          // pd logical time the mapping is measured from
+  double                  clk_offset;          // smoothed lsl_local_clock minus logical time (s)
+  int                     clk_valid;
+  double                  latency;             // output latency added to every stamp (ms)
   
 }t_lsl_outlet;
 
 // helper function declarations:
 int parse_and_create_outlet(t_lsl_outlet *x, int argc, t_atom *argv);
+static int format_size(lsl_channel_format_t cft);
+static int setup_push_buf(t_lsl_outlet *x);
+static void free_push_buf(t_lsl_outlet *x);
+static int pack_sample(t_lsl_outlet *x, int argc, t_atom *argv);
+static void push_packed(t_lsl_outlet *x);
+static void flush_chunk(t_lsl_outlet *x);
+static void store_value(lsl_channel_format_t cft, char *buf, int i, double v);
+static void push_chunk_buf(t_lsl_outlet *x, char *buf, unsigned long n, double *ts);
+static void start_watcher(t_lsl_outlet *x);
+static void stop_watcher(t_lsl_outlet *x);
+static void send_triggers(t_lsl_outlet *x);
+static double logical_lsl_time(t_lsl_outlet *x);
+static void lsl_outlet_sync(t_lsl_outlet *x);
+
+// clock mapping:
+// samples get stamped with the lsl time of the logical time they were
+// sent at (plus the output latency) rather than whenever the call
+// happens to run, which would include the scheduler's jitter. the
+// offset between the two clocks is sampled every SYNC_INTERVAL ms and
+// smoothed so that the jitter of the samples themselves averages out
+#define SYNC_INTERVAL 50
+
+static void lsl_outlet_sync(t_lsl_outlet *x){
+
+  double raw = lsl_local_clock() - clock_gettimesince(x->clk_anchor) * 0.001;
+
+  if(!x->clk_valid){
+    x->clk_offset = raw;
+    x->clk_valid = 1;
+  }
+  else x->clk_offset += 0.02 * (raw - x->clk_offset);
+  clock_delay(x->sync_clock, SYNC_INTERVAL);
+}
+
+static double logical_lsl_time(t_lsl_outlet *x){
+
+  if(!x->clk_valid)lsl_outlet_sync(x);
+  return clock_gettimesince(x->clk_anchor) * 0.001 + x->clk_offset + x->latency * 0.001;
+}
+
+// consumer watcher:
+// the thread only ever writes the flag, the clock reports changes of it.
+// with a trigger inlet it also sends whatever markers the perform routine
+// found, so it wakes up every ms instead of every 10
+static void *lsl_consumer_watcher(void *in){
+
+  t_lsl_outlet *x = (t_lsl_outlet *)in;
+  int waited = CONSUMER_POLL;
+  int nap = x->trigger ? 1 : 10;
+
+  while(x->stop_==0){
+    if(waited >= CONSUMER_POLL){
+      x->consumers = lsl_have_consumers(x->lsl_outlet_obj);
+      waited = 0;
+    }
+    if(x->trigger)send_triggers(x);
+    sleep_ms(nap);
+    waited += nap;
+  }
+  return NULL;
+}
+
+// everything in the trigger ring goes out as one chunk, the marker is the
+// sample's value in the first channel (as text for string streams)
+static void send_triggers(t_lsl_outlet *x){
+
+  int ridx = x->trig_ridx;
+  int widx = x->trig_widx;
+  int nch = x->nchannels;
+  int n = 0, ch;
+  char *field;
+
+  memory_barrier();
+  while(ridx != widx){
+    for(ch=0;ch<nch;ch++){
+      if(x->cft==cft_string){
+	field = x->trig_str + (n * nch + ch) * STR_FIELD;
+	if(ch==0)sprintf(field, "%g", x->trig_ring[ridx].val);
+	else field[0] = '\0';
+	((char **)x->trig_buf)[n * nch + ch] = field;
+      }
+      else store_value(x->cft, x->trig_buf, n * nch + ch, ch==0 ? x->trig_ring[ridx].val : 0);
+    }
+    x->trig_ts[n++] = x->trig_ring[ridx].t;
+    ridx = (ridx + 1) % TRIGGER_RINGLEN;
+  }
+  if(n>0)push_chunk_buf(x, x->trig_buf, n * nch, x->trig_ts);
+  memory_barrier();
+  x->trig_ridx = ridx;
+}
+
+// the outlet must stay alive until stop_watcher returns
+static void start_watcher(t_lsl_outlet *x){
+
+  if(x->watching)return;
+  x->stop_ = 0;
+  x->consumers = 0;
+  if(pthread_create(&x->tid, NULL, lsl_consumer_watcher, (void *)x)!=0){
+    pd_error(x, "lsl_outlet: error launching consumer watcher, pushing regardless");
+    x->consumers = 1;
+    return;
+  }
+  x->watching = 1;
+}
+
+static void stop_watcher(t_lsl_outlet *x){
+
+  if(!x->watching)return;
+  x->stop_ = 1;
+  pthread_join(x->tid, NULL);
+  x->watching = 0;
+  x->consumers = 0;
+}
+
+static void lsl_outlet_consumers_poll(t_lsl_outlet *x){
+
+  int consumers = x->consumers;
+
+  if(consumers != x->consumers_reported){
+    x->consumers_reported = consumers;
+    outlet_float(x->consumers_outlet, consumers);
+  }
+  if(x->trig_dropped != x->trig_reported){
+    pd_error(x, "lsl_outlet: %lu triggers came too fast and were dropped",
+	     x->trig_dropped - x->trig_reported);
+    x->trig_reported = x->trig_dropped;
+  }
+  clock_delay(x->consumers_clock, CONSUMER_POLL);
+}
+
+static int format_size(lsl_channel_format_t cft){
+
+  switch(cft){
+  case cft_float32: return sizeof(float);
+  case cft_double64: return sizeof(double);
+  case cft_int32: return sizeof(int);
+  case cft_int16: return sizeof(short);
+  case cft_int8: return sizeof(char);
+  case cft_string: return sizeof(char *);
+  default: return 0;
+  }
+}
+
+static void free_push_buf(t_lsl_outlet *x){
+
+  if(x->push_buf!=NULL){
+    t_freebytes(x->push_buf, x->chunk_size * x->nchannels * format_size(x->cft));
+    x->push_buf = NULL;
+  }
+  if(x->str_store!=NULL){
+    t_freebytes(x->str_store, x->chunk_size * x->nchannels * STR_FIELD);
+    x->str_store = NULL;
+  }
+  if(x->ts_buf!=NULL){
+    t_freebytes(x->ts_buf, x->chunk_size * sizeof(double));
+    x->ts_buf = NULL;
+  }
+  if(x->trig_buf!=NULL){
+    t_freebytes(x->trig_buf, TRIGGER_RINGLEN * x->nchannels * format_size(x->cft));
+    t_freebytes(x->trig_ts, TRIGGER_RINGLEN * sizeof(double));
+    x->trig_buf = NULL;
+    x->trig_ts = NULL;
+  }
+  if(x->trig_str!=NULL){
+    t_freebytes(x->trig_str, TRIGGER_RINGLEN * x->nchannels * STR_FIELD);
+    x->trig_str = NULL;
+  }
+  x->nbuffered = 0;
+}
+
+// allocated once per outlet so that push doesn't touch the allocator
+static int setup_push_buf(t_lsl_outlet *x){
+
+  x->nbuffered = 0;
+  x->push_buf = (char *)t_getbytes(x->chunk_size * x->nchannels * format_size(x->cft));
+  x->ts_buf = (double *)t_getbytes(x->chunk_size * sizeof(double));
+  if(x->push_buf==NULL || x->ts_buf==NULL){
+    free_push_buf(x);
+    return -1;
+  }
+  if(x->cft==cft_string){
+    x->str_store = (char *)t_getbytes(x->chunk_size * x->nchannels * STR_FIELD);
+    if(x->str_store==NULL){
+      free_push_buf(x);
+      return -1;
+    }
+  }
+  if(x->trigger){
+    x->trig_buf = (char *)t_getbytes(TRIGGER_RINGLEN * x->nchannels * format_size(x->cft));
+    x->trig_ts = (double *)t_getbytes(TRIGGER_RINGLEN * sizeof(double));
+    if(x->cft==cft_string)
+      x->trig_str = (char *)t_getbytes(TRIGGER_RINGLEN * x->nchannels * STR_FIELD);
+    if(x->trig_buf==NULL || x->trig_ts==NULL || (x->cft==cft_string && x->trig_str==NULL)){
+      free_push_buf(x);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// convert a pd list into the next free sample of push_buf
+// missing channels are zero (or empty strings), extra atoms are dropped
+// numbers are clamped to the range of the integer formats
+static int pack_sample(t_lsl_outlet *x, int argc, t_atom *argv){
+
+  int i;
+  int first = x->nbuffered * x->nchannels;
+  char *slot = x->push_buf + first * format_size(x->cft);
+
+  if(argc!=x->nchannels)
+    pd_error(x, "lsl_outlet: got %d values for %d channels", argc, x->nchannels);
+
+  for(i=0;i<x->nchannels;i++){
+    if(x->cft==cft_string){
+      char *field = x->str_store + (first + i) * STR_FIELD;
+      if(i<argc && argv[i].a_type==A_SYMBOL)
+	((char **)slot)[i] = argv[i].a_w.w_symbol->s_name;
+      else{
+	if(i<argc)atom_string(&argv[i], field, STR_FIELD);
+	else field[0] = '\0';
+	((char **)slot)[i] = field;
+      }
+      continue;
+    }
+
+    if(i<argc && argv[i].a_type!=A_FLOAT){
+      pd_error(x, "lsl_outlet: channel %d: %s is not a number",
+	       i, atom_getsymbol(&argv[i])->s_name);
+      return -1;
+    }
+    store_value(x->cft, slot, i, i<argc ? argv[i].a_w.w_float : 0);
+  }
+  return 0;
+}
+
+// element i of a buffer of numbers in format cft
+static void store_value(lsl_channel_format_t cft, char *buf, int i, double v){
+
+  switch(cft){
+  case cft_float32: ((float *)buf)[i] = v; break;
+  case cft_double64: ((double *)buf)[i] = v; break;
+  case cft_int32:
+    if(v>2147483647.)v = 2147483647.;
+    else if(v<-2147483648.)v = -2147483648.;
+    ((int *)buf)[i] = (int)v;
+    break;
+  case cft_int16:
+    if(v>32767)v = 32767;
+    else if(v<-32768)v = -32768;
+    ((short *)buf)[i] = (short)v;
+    break;
+  case cft_int8:
+    if(v>127)v = 127;
+    else if(v<-128)v = -128;
+    ((char *)buf)[i] = (char)v;
+    break;
+  default: break;
+  }
+}
+
+// send the sample pack_sample just wrote, or queue it if we're chunking
+static void push_packed(t_lsl_outlet *x){
+
+  double ts = logical_lsl_time(x);
+
+  if(x->chunk_size>1){
+    x->ts_buf[x->nbuffered++] = ts;
+    if(x->nbuffered == x->chunk_size)flush_chunk(x);
+    else if(x->nbuffered == 1 && x->flush_interval > 0)
+      clock_delay(x->flush_clock, x->flush_interval);
+    return;
+  }
+
+  switch(x->cft){
+  case cft_float32: lsl_push_sample_ft(x->lsl_outlet_obj, (float *)x->push_buf, ts); break;
+  case cft_double64: lsl_push_sample_dt(x->lsl_outlet_obj, (double *)x->push_buf, ts); break;
+  case cft_int32: lsl_push_sample_it(x->lsl_outlet_obj, (int *)x->push_buf, ts); break;
+  case cft_int16: lsl_push_sample_st(x->lsl_outlet_obj, (short *)x->push_buf, ts); break;
+  case cft_int8: lsl_push_sample_ct(x->lsl_outlet_obj, x->push_buf, ts); break;
+  case cft_string: lsl_push_sample_strt(x->lsl_outlet_obj, (char **)x->push_buf, ts); break;
+  default: break;
+  }
+}
+
+// n values in the outlet's format, one stamp per sample
+static void push_chunk_buf(t_lsl_outlet *x, char *buf, unsigned long n, double *ts){
+
+  switch(x->cft){
+  case cft_float32: lsl_push_chunk_ftn(x->lsl_outlet_obj, (float *)buf, n, ts); break;
+  case cft_double64: lsl_push_chunk_dtn(x->lsl_outlet_obj, (double *)buf, n, ts); break;
+  case cft_int32: lsl_push_chunk_itn(x->lsl_outlet_obj, (int *)buf, n, ts); break;
+  case cft_int16: lsl_push_chunk_stn(x->lsl_outlet_obj, (short *)buf, n, ts); break;
+  case cft_int8: lsl_push_chunk_ctn(x->lsl_outlet_obj, buf, n, ts); break;
+  case cft_string: lsl_push_chunk_strtn(x->lsl_outlet_obj, (char **)buf, n, ts); break;
+  default: break;
+  }
+}
+
+// everything buffered goes out as one chunk, every sample keeps its stamp
+static void flush_chunk(t_lsl_outlet *x){
+
+  clock_unset(x->flush_clock);
+  if(x->nbuffered==0 || x->lsl_outlet_obj==NULL)return;
+  push_chunk_buf(x, x->push_buf, x->nbuffered * x->nchannels, x->ts_buf);
+  x->nbuffered = 0;
+}
 
 // helper function definitions
 int parse_and_create_outlet(t_lsl_outlet *x, int argc, t_atom *argv){
@@ -46,7 +413,11 @@ int parse_and_create_outlet(t_lsl_outlet *x, int argc, t_atom *argv){
   char stream_type[100];
   char stream_format[100];
   int srate = 0;
-  int channel_format;
+  int channel_format = cft_undefined;
+  int nchannels = 1;
+  int chunk_size = 1;
+  int max_buffered = 360;
+  double flush_interval = 100;
   char source_id[100];
 
   t_symbol *arg1, *arg2;
@@ -78,9 +449,24 @@ int parse_and_create_outlet(t_lsl_outlet *x, int argc, t_atom *argv){
       {
 	arg2 = atom_getsymbolarg(1,argc,argv);
   	strcpy(stream_format, arg2->s_name);
-	if(!strcmp(stream_format, "cft_float32")){res*=2;channel_format = cft_float32;x->cft=cft_float32;}
-	else if(!strcmp(stream_format, "cft_string")){res*=2;channel_format = cft_string;x->cft=cft_string;}
+	if(!strcmp(stream_format, "cft_float32"))channel_format = cft_float32;
+	else if(!strcmp(stream_format, "cft_double64"))channel_format = cft_double64;
+	else if(!strcmp(stream_format, "cft_int32"))channel_format = cft_int32;
+	else if(!strcmp(stream_format, "cft_int16"))channel_format = cft_int16;
+	else if(!strcmp(stream_format, "cft_int8"))channel_format = cft_int8;
+	else if(!strcmp(stream_format, "cft_string"))channel_format = cft_string;
 	else {pd_error(x, "invalid channel type: %s", stream_format); return -1;}
+	res*=2;
+  	argc-=2, argv+=2;
+      }
+
+    else if(!strcmp(arg1->s_name, "-channels"))
+      {
+	nchannels = atom_getfloatarg(1,argc,argv);
+	if(nchannels<1){
+	  pd_error(x, "lsl_outlet: -channels must be at least 1");
+	  return -1;
+	}
   	argc-=2, argv+=2;
       }
     
@@ -90,6 +476,37 @@ int parse_and_create_outlet(t_lsl_outlet *x, int argc, t_atom *argv){
   	strcpy(source_id, arg2->s_name);
   	argc-=2, argv+=2;
       }
+
+    else if(!strcmp(arg1->s_name, "-chunk_size"))
+      {
+	chunk_size = atom_getfloatarg(1,argc,argv);
+	if(chunk_size<1)chunk_size = 1;
+  	argc-=2, argv+=2;
+      }
+
+    else if(!strcmp(arg1->s_name, "-max_buffered"))
+      {
+	max_buffered = atom_getfloatarg(1,argc,argv);
+	if(max_buffered<1)max_buffered = 1;
+  	argc-=2, argv+=2;
+      }
+
+    else if(!strcmp(arg1->s_name, "-flush"))
+      {
+	flush_interval = atom_getfloatarg(1,argc,argv);
+	if(flush_interval<0)flush_interval = 0;
+  	argc-=2, argv+=2;
+      }
+
+    // only meaningful as a creation argument, it's consumed in lsl_outlet_new
+    else if(!strcmp(arg1->s_name, "-trigger"))
+      argc-=2, argv+=2;
+
+    else if(!strcmp(arg1->s_name, "-latency"))
+      {
+	x->latency = atom_getfloatarg(1,argc,argv);
+  	argc-=2, argv+=2;
+      }
     
  
     else{
@@ -101,8 +518,18 @@ int parse_and_create_outlet(t_lsl_outlet *x, int argc, t_atom *argv){
 
   // we only go if we got enough correct input parameters
   if(res==8){
-    info = lsl_create_streaminfo(stream_name, stream_type, 1, 0, channel_format, source_id);
-    x->lsl_outlet_obj = lsl_create_outlet(info, 0, 360);
+    x->cft = channel_format;
+    x->nchannels = nchannels;
+    x->chunk_size = chunk_size;
+    x->flush_interval = flush_interval;
+    if(setup_push_buf(x)!=0){
+      pd_error(x, "lsl_outlet: unable to allocate sample buffer");
+      return -1;
+    }
+    info = lsl_create_streaminfo(stream_name, stream_type, nchannels, 0, channel_format, source_id);
+    // liblsl's own chunk size stays 0: every flush is one transfer already.
+    // max_buffered is in hundreds of samples since the rate is irregular
+    x->lsl_outlet_obj = lsl_create_outlet(info, 0, max_buffered);
     res = 0;
   }
   else res = -1; // failed
@@ -114,50 +541,217 @@ int parse_and_create_outlet(t_lsl_outlet *x, int argc, t_atom *argv){
 void lsl_outlet_create_outlet(t_lsl_outlet *x, t_symbol *s, int argc, t_atom *argv){
   int res;
   x->outlet_established = 0;
+  if(!pdlsl_lib_load(x)){
+    outlet_float(x->f_outlet, 0);
+    return;
+  }
+  if(!x->clk_valid)lsl_outlet_sync(x);
+  flush_chunk(x);
+  stop_watcher(x);
   if(x->lsl_outlet_obj!=NULL){
     lsl_destroy_outlet(x->lsl_outlet_obj);
     x->lsl_outlet_obj=NULL;
   }
+  free_push_buf(x);
   res = parse_and_create_outlet(x, argc, argv);
+  if(res==0)start_watcher(x);
   if(res==0)x->outlet_established = 1;
   else x->outlet_established = 0;
   outlet_float(x->f_outlet, x->outlet_established);
 }
 
+// one value per channel, sent as a single sample in the outlet's format
+void lsl_outlet_push(t_lsl_outlet *x, t_symbol *s, int argc, t_atom *argv){
+
+  if(x->outlet_established!=1 || !x->consumers)return;
+  if(pack_sample(x, argc, argv)!=0)return;
+  push_packed(x);
+}
+
 void lsl_outlet_push_str(t_lsl_outlet *x, t_symbol *s, int argc, t_atom *argv){
 
   char *str;
   int ec;
   
-  if(x->outlet_established!=1)return;
+  if(x->outlet_established!=1 || !x->consumers)return;
   if(x->cft!=cft_string){
     post("invalid argument to push_str");
     return;
   }
+  if(x->nchannels!=1 || x->chunk_size>1){
+    lsl_outlet_push(x, s, argc, argv);
+    return;
+  }
 
   str = atom_getsymbolarg(0, argc, argv)->s_name;
-  ec=lsl_push_sample_str(x->lsl_outlet_obj, &str);
+  ec=lsl_push_sample_strt(x->lsl_outlet_obj, &str, logical_lsl_time(x));
 
 }
 
+// any numeric format, channels past the first are zero
 void lsl_outlet_push_f(t_lsl_outlet *x, t_floatarg f){
 
-  int ec;
-  if(x->outlet_established!=1)return;
-  if(x->cft!=cft_float32){
+  t_atom a;
+  if(x->outlet_established!=1 || !x->consumers)return;
+  if(x->cft==cft_string){
     post("invalid argument to push_f");
     return;
   }
-  ec=lsl_push_sample_f(x->lsl_outlet_obj, &f);
+  SETFLOAT(&a, f);
+  if(pack_sample(x, 1, &a)!=0)return;
+  push_packed(x);
+}
+
+// array <name> <onset> <count> [<interval ms> | <stamp array>]
+// pushes count samples of an array (frames of nchannels values for a
+// multichannel stream) starting at sample onset. the first sample is
+// stamped with the current logical time and the rest follow at interval
+// ms (default 0), or at the offsets in ms from now that the stamp array
+// holds for the same samples. the array's words are converted to the
+// stream's format and pushed ARRAY_BLOCK samples at a time
+#define ARRAY_BLOCK 256
+
+void lsl_outlet_array(t_lsl_outlet *x, t_symbol *s, int argc, t_atom *argv){
+
+  t_symbol *name = atom_getsymbolarg(0, argc, argv);
+  int onset = atom_getfloatarg(1, argc, argv);
+  int count = atom_getfloatarg(2, argc, argv);
+  int nch = x->nchannels;
+  t_garray *a, *ta = NULL;
+  t_word *vec, *tvec = NULL, *src;
+  int size, tsize, done, n, i;
+  double interval = 0, now;
+  double *ts;
+  char *conv;
+
+  if(x->outlet_established!=1)return;
+  if(x->cft==cft_string){
+    pd_error(x, "lsl_outlet: array: string streams can't take arrays");
+    return;
+  }
+  if(!(a = (t_garray *)pd_findbyclass(name, garray_class))){
+    pd_error(x, "lsl_outlet: array: %s: no such array", name->s_name);
+    return;
+  }
+  if(!garray_getfloatwords(a, &size, &vec)){
+    pd_error(x, "lsl_outlet: array: %s: bad template", name->s_name);
+    return;
+  }
+  size /= nch;
+  if(onset<0)onset = 0;
+  if(count<=0 || onset + count > size)count = size - onset;
+  if(count<=0)return;
+
+  if(argc>3 && argv[3].a_type==A_SYMBOL){
+    if(!(ta = (t_garray *)pd_findbyclass(argv[3].a_w.w_symbol, garray_class)) ||
+       !garray_getfloatwords(ta, &tsize, &tvec)){
+      pd_error(x, "lsl_outlet: array: %s: no such array", argv[3].a_w.w_symbol->s_name);
+      return;
+    }
+    if(tsize < onset + count){
+      pd_error(x, "lsl_outlet: array: %s is too short for the stamps", argv[3].a_w.w_symbol->s_name);
+      return;
+    }
+  }
+  else interval = atom_getfloatarg(3, argc, argv);
+
+  if(!x->consumers)return;
+
+  // whatever was queued before has to go out first
+  flush_chunk(x);
+  now = logical_lsl_time(x);
+  ts = (double *)t_getbytes(sizeof(double) * ARRAY_BLOCK);
+  conv = (char *)t_getbytes(ARRAY_BLOCK * nch * format_size(x->cft));
+
+  for(done=0;done<count;done+=n){
+    n = (count - done > ARRAY_BLOCK) ? ARRAY_BLOCK : count - done;
+    for(i=0;i<n;i++)
+      ts[i] = now + 0.001 * (tvec ? tvec[onset + done + i].w_float : (done + i) * interval);
+    src = vec + (onset + done) * nch;
+    for(i=0;i<n*nch;i++)store_value(x->cft, conv, i, src[i].w_float);
+    push_chunk_buf(x, conv, n * nch, ts);
+  }
+
+  t_freebytes(ts, sizeof(double) * ARRAY_BLOCK);
+  t_freebytes(conv, ARRAY_BLOCK * nch * format_size(x->cft));
+}
+
+// dsp
+// the perform routine only looks for triggers and queues them with the
+// lsl time of their exact sample, it never calls into liblsl
+static t_int *lsl_outlet_perform(t_int *w){
+
+  t_lsl_outlet *x = (t_lsl_outlet *)(w[1]);
+  t_sample *in = (t_sample *)(w[2]);
+  int n = (int)(w[3]);
+  int i, hit, next;
+  int widx = x->trig_widx;
+  t_sample prev = x->trig_prev;
+  double t0 = -1;
+
+  if(x->outlet_established!=1 || !x->consumers){
+    x->trig_prev = in[n-1];
+    return (w+4);
+  }
+
+  for(i=0;i<n;i++){
+    hit = (x->trigger==TRIGGER_EDGE) ? (in[i]>0 && prev<=0) : (in[i]!=0);
+    prev = in[i];
+    if(!hit)continue;
+
+    next = (widx + 1) % TRIGGER_RINGLEN;
+    if(next == x->trig_ridx){
+      x->trig_dropped++;
+      continue;
+    }
+    // pd advances logical time before it computes the block, so the
+    // block's first sample is n samples before it
+    if(t0<0)t0 = logical_lsl_time(x) - n / x->sr;
+    x->trig_ring[widx].t = t0 + i / x->sr;
+    x->trig_ring[widx].val = in[i];
+    widx = next;
+  }
+  x->trig_prev = prev;
+
+  memory_barrier();
+  x->trig_widx = widx;
+  return (w+4);
+}
+
+static void lsl_outlet_dsp(t_lsl_outlet *x, t_signal **sp){
+
+  if(!x->trigger)return;
+  x->sr = sp[0]->s_sr;
+  dsp_add(lsl_outlet_perform, 3, x, sp[0]->s_vec, sp[0]->s_n);
+}
+
+// send whatever is buffered right now
+void lsl_outlet_flush(t_lsl_outlet *x){
+
+  flush_chunk(x);
+}
+
+void lsl_outlet_have_consumers(t_lsl_outlet *x){
+
+  outlet_float(x->consumers_outlet, x->consumers);
+}
+
+// calibrated delay between pd's logical time and the sound leaving the speaker
+void lsl_outlet_latency(t_lsl_outlet *x, t_floatarg f){
+
+  x->latency = f;
 }
 
 void lsl_outlet_destroy_outlet(t_lsl_outlet *x){
 
+  flush_chunk(x);
+  stop_watcher(x);
   if(x->lsl_outlet_obj!=NULL){
     lsl_destroy_outlet(x->lsl_outlet_obj);
     x->lsl_outlet_obj = NULL;
     x->outlet_established=0;
   }
+  free_push_buf(x);
   outlet_float(x->f_outlet, x->outlet_established);
 
 }
@@ -170,14 +764,62 @@ void lsl_outlet_is_outlet_established(t_lsl_outlet *x){
 void *lsl_outlet_new(t_symbol *s, int argc, t_atom *argv){
 
   int i;
+  t_symbol *mode;
   t_lsl_outlet *x = (t_lsl_outlet *)pd_new(lsl_outlet_class);
 
+  // -trigger edge|nonzero adds a signal inlet, so it has to be known up front
+  x->trigger = TRIGGER_OFF;
+  for(i=0;i<argc-1;i++)
+    if(!strcmp(atom_getsymbolarg(i, argc, argv)->s_name, "-trigger")){
+      mode = atom_getsymbolarg(i+1, argc, argv);
+      if(!strcmp(mode->s_name, "edge"))x->trigger = TRIGGER_EDGE;
+      else if(!strcmp(mode->s_name, "nonzero"))x->trigger = TRIGGER_NONZERO;
+      else pd_error(x, "lsl_outlet: -trigger %s: must be edge or nonzero", mode->s_name);
+    }
+  if(x->trigger)
+    inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
+  x->sr = sys_getsr();
+  x->trig_widx = x->trig_ridx = 0;
+  x->trig_dropped = x->trig_reported = 0;
+  x->trig_prev = 0;
+  x->trig_buf = NULL;
+  x->trig_str = NULL;
+  x->trig_ts = NULL;
+
   x->f_outlet = outlet_new(&x->x_obj, &s_float);
+  x->consumers_outlet = outlet_new(&x->x_obj, &s_float);
   
   x->lsl_outlet_obj = NULL;
   x->outlet_established = 0;
-
-  if(argc>0)lsl_outlet_create_outlet(x, s, argc, argv);
+  x->cft = cft_float32;
+  x->nchannels = 1;
+  x->push_buf = NULL;
+  x->str_store = NULL;
+  x->ts_buf = NULL;
+  x->chunk_size = 1;
+  x->nbuffered = 0;
+  x->flush_interval = 0;
+  x->flush_clock = clock_new(x, (t_method)flush_chunk);
+
+  x->consumers = 0;
+  x->consumers_reported = 0;
+  x->watching = 0;
+  x->stop_ = 1;
+  x->consumers_clock = clock_new(x, (t_method)lsl_outlet_consumers_poll);
+  clock_delay(x->consumers_clock, CONSUMER_POLL);
+
+  x->latency = 0;
+  x->clk_anchor = clock_getlogicaltime();
+  x->clk_valid = 0;
+  // the mapping starts with the first outlet, liblsl isn't loaded before
+  x->sync_clock = clock_new(x, (t_method)lsl_outlet_sync);
+
+  // anything beyond -trigger means we create the outlet right away
+  for(i=0;i<argc;i+=2)
+    if(strcmp(atom_getsymbolarg(i, argc, argv)->s_name, "-trigger")){
+      lsl_outlet_create_outlet(x, s, argc, argv);
+      break;
+    }
   return x;
     
 }
@@ -185,7 +827,13 @@ void *lsl_outlet_new(t_symbol *s, int argc, t_atom *argv){
 
 void lsl_outlet_free(t_lsl_outlet *x){
 
+  flush_chunk(x);
+  stop_watcher(x);
   if(x->lsl_outlet_obj!=NULL)lsl_destroy_outlet(x->lsl_outlet_obj);
+  free_push_buf(x);
+  clock_free(x->flush_clock);
+  clock_free(x->sync_clock);
+  clock_free(x->consumers_clock);
 }
 
 void lsl_outlet_setup(void){
@@ -198,12 +846,23 @@ void lsl_outlet_setup(void){
 			      A_GIMME,
 			      0);
 
+  class_addmethod(lsl_outlet_class,
+		  (t_method)lsl_outlet_dsp,
+		  gensym("dsp"),
+		  0);
+
   class_addmethod(lsl_outlet_class,
 		  (t_method)lsl_outlet_create_outlet,
 		  gensym("create_outlet"),
 		  A_GIMME,
 		  0);
 
+  class_addmethod(lsl_outlet_class,
+  		  (t_method)lsl_outlet_push,
+  		  gensym("push"),
+  		  A_GIMME,
+  		  0);
+
   class_addmethod(lsl_outlet_class,
   		  (t_method)lsl_outlet_push_str,
   		  gensym("push_str"),
@@ -216,11 +875,33 @@ void lsl_outlet_setup(void){
   		  A_DEFFLOAT,
   		  0);
 
+  class_addmethod(lsl_outlet_class,
+  		  (t_method)lsl_outlet_latency,
+  		  gensym("latency"),
+  		  A_FLOAT,
+  		  0);
+
   class_addmethod(lsl_outlet_class,
 		  (t_method)lsl_outlet_destroy_outlet,
 		  gensym("destroy_outlet"),
 		  0);
 
+  class_addmethod(lsl_outlet_class,
+		  (t_method)lsl_outlet_array,
+		  gensym("array"),
+		  A_GIMME,
+		  0);
+
+  class_addmethod(lsl_outlet_class,
+		  (t_method)lsl_outlet_flush,
+		  gensym("flush"),
+		  0);
+
+  class_addmethod(lsl_outlet_class,
+		  (t_method)lsl_outlet_have_consumers,
+		  gensym("have_consumers"),
+		  0);
+
   class_addmethod(lsl_outlet_class,
 		  (t_method)lsl_outlet_is_outlet_established,
 		  gensym("is_outlet_established"),
@@ -0,0 +1,913 @@
+/**************** lsl_outlet~ **************/
+/* Written by David Medine on behalf of    */
+/* Brain Products                          */ 
+/* 15/5/2017                               */
+/* Released under the GPL                  */
+/* This software is free and open source   */
+/*******************************************/
+
+
+#include "m_pd.h"
+#include "pdlsl_lib.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "pthread.h"
+
+#ifdef _WIN32
+#include "windows.h"
+#define memory_barrier() MemoryBarrier()
+#define sleep_ms(ms) Sleep(ms)
+#else
+#include <unistd.h>
+#define memory_barrier() __sync_synchronize()
+#define sleep_ms(ms) usleep((ms)*1000)
+#endif
+
+#define REPORT_INTERVAL 250          // ms between checks of the drop counter
+#define CONSUMER_POLL   0.2          // s between the sender's checks for consumers
+#define MAX_INTERP      64           // largest upsampling factor of the rational resampler
+#define SYNC_INTERVAL   50           // ms between refinements of the clock mapping
+
+// polyphase FIR sampling rate converter: out rate = in rate * L / M.
+// only the outputs are ever computed, so a 48k -> 500Hz stream costs
+// taps-per-phase multiply-adds per channel 500 times a second
+typedef struct _decimator{
+  int         L, M;                 // interpolation and decimation factors
+  int         K;                    // taps per phase
+  float       *h;                   // L * K, phase major, each phase reversed so it lines up with hist
+  float       *hist;                // nchannels * 2K, every sample is written twice so the last K are contiguous
+  int         hpos;                 // write position in [0, K)
+  double      next_up;              // upsampled index of the next output
+  double      in_count;             // input frames consumed so far
+  float       *out;                 // output frames of one push, interleaved
+  int         outlen;               // capacity of out in frames
+  double      delay;                // group delay of the filter in seconds
+}t_decimator;
+
+// pd boilerplate:
+static t_class *lsl_outlet_tilde_class;
+
+typedef struct _lsl_outlet_tilde{
+
+  t_object    x_obj;
+  t_float     f;                    // dummy for the main signal inlet
+  t_outlet    *f_outlet;
+
+  t_outlet    *info_outlet;
+
+  int         nchannels;            // number of signal inlets == channels in the stream
+  int         blksize;              // samples per dsp block
+  t_float     sr;                   // pd's sampling rate, also the stream's nominal rate
+
+  // the perform routine only copies into this ring, the sender thread
+  // does all the talking to liblsl. frames are written a whole block at
+  // a time and the capacity is a multiple of the block size, so a block
+  // never wraps and its stamp lives at ts_ring[frame/blksize]
+  float       *ring;                // ringlen * nchannels, interleaved
+  double      *ts_ring;             // stamp of the last sample of each block
+  int         ringlen;              // in frames
+  int         ring_blocks;          // requested capacity in dsp blocks
+  volatile unsigned long wcount;    // frames written (perform only)
+  volatile unsigned long rcount;    // frames read (sender only)
+  unsigned long dropped;            // blocks the perform routine couldn't fit (perform only)
+  unsigned long reported;           // dropped count at the last report (pd thread only)
+  t_clock     *report_clock;
+
+  // sender thread
+  pthread_t       tid;
+  pthread_mutex_t push_lock;        // held while pushing, and while the outlet is replaced
+  int             stop_;
+  int             running;
+  int             batch;            // minimum frames per push
+  int             pushthrough;      // passed to liblsl, 0 lets it collect more before sending
+
+  // the sender asks lsl_have_consumers now and then, while nobody is
+  // subscribed the perform routine doesn't even copy the block
+  volatile int    consumers;
+  volatile double next_poll;        // lsl time of the sender's next check, 0 forces one
+  int             consumers_reported;
+
+  // decimation in the sender (srate_out==0 means stream at pd's rate)
+  double          srate_out;        // requested nominal rate of the stream
+  int             decimate;         // flag to say the decimator is set up
+  t_decimator     dec;
+
+  // optional int16 transport, value = q * scale + offset per channel.
+  // the factors go into the stream's desc so lsl_inlet~ can undo it
+  int             quantize;
+  float           *q_scale;
+  float           *q_offset;
+  float           *q_inv;           // 1/q_scale, set when the outlet is created
+  short           *q_buf;           // ringlen + 2 frames, enough for one push either way
+
+  lsl_outlet              lsl_outlet_obj;      // instantiation of the outlet class
+  float                   outlet_established;
+
+  // kept around so the outlet can be recreated if pd's sampling rate changes
+  char                    stream_name[100];
+  char                    stream_type[100];
+  char                    source_id[100];
+
+  // mapping of pd's logical time onto the lsl clock for timestamping
+  t_clock                 *sync_clock;         // periodically refines clk_offset
+  double                  clk_anchor;          // pd logical time the mapping is measured from
+  double                  clk_offset;          // smoothed lsl_local_clock minus logical time (s)
+  int                     clk_valid;
+  double                  latency;             // output latency added to every stamp (ms)
+
+}t_lsl_outlet_tilde;
+
+// helper function declarations:
+void lsl_outlet_tilde_batch(t_lsl_outlet_tilde *x, t_floatarg f);
+static int parse_and_create_outlet(t_lsl_outlet_tilde *x, int argc, t_atom *argv);
+static int create_outlet(t_lsl_outlet_tilde *x);
+static void setup_ring(t_lsl_outlet_tilde *x, int blksize);
+static void free_ring(t_lsl_outlet_tilde *x);
+static void start_sender(t_lsl_outlet_tilde *x);
+static void stop_sender(t_lsl_outlet_tilde *x);
+static double block_lsl_time(t_lsl_outlet_tilde *x);
+static void lsl_outlet_tilde_sync(t_lsl_outlet_tilde *x);
+static int setup_decimator(t_lsl_outlet_tilde *x);
+static void free_decimator(t_lsl_outlet_tilde *x);
+static int decimate_frames(t_lsl_outlet_tilde *x, float *in, int frames);
+static void reset_decimator(t_lsl_outlet_tilde *x);
+static void quantize_frames(t_lsl_outlet_tilde *x, float *in, int frames);
+static void write_scale_desc(t_lsl_outlet_tilde *x, lsl_streaminfo info);
+
+// helper function definitions
+static int parse_and_create_outlet(t_lsl_outlet_tilde *x, int argc, t_atom *argv){
+
+  t_symbol *arg1;
+  int got_name = 0;
+  int i;
+
+  strcpy(x->stream_name, "\n");
+  strcpy(x->source_id, "\n");               // this is optional, but needed in the c api so default is empty
+  strcpy(x->stream_type, "pd_lsl");         // also optional
+
+  while(argc > 0) {
+    arg1 = atom_getsymbolarg(0, argc, argv);
+    if(!strcmp(arg1->s_name, "-name"))
+      {
+	strncpy(x->stream_name, atom_getsymbolarg(1,argc,argv)->s_name, 99);
+	x->stream_name[99] = 0;
+  	argc-=2, argv+=2;
+	got_name = 1;
+      }
+
+    else if(!strcmp(arg1->s_name, "-type"))
+      {
+	strncpy(x->stream_type, atom_getsymbolarg(1,argc,argv)->s_name, 99);
+	x->stream_type[99] = 0;
+  	argc-=2, argv+=2;
+      }
+
+    else if(!strcmp(arg1->s_name, "-id"))
+      {
+	strncpy(x->source_id, atom_getsymbolarg(1,argc,argv)->s_name, 99);
+	x->source_id[99] = 0;
+  	argc-=2, argv+=2;
+      }
+
+    else if(!strcmp(arg1->s_name, "-latency"))
+      {
+	x->latency = atom_getfloatarg(1,argc,argv);
+  	argc-=2, argv+=2;
+      }
+
+    else if(!strcmp(arg1->s_name, "-srate"))
+      {
+	x->srate_out = atom_getfloatarg(1,argc,argv);
+	if(x->srate_out<0)x->srate_out = 0;
+  	argc-=2, argv+=2;
+      }
+
+    else if(!strcmp(arg1->s_name, "-format"))
+      {
+	arg1 = atom_getsymbolarg(1,argc,argv);
+	if(!strcmp(arg1->s_name, "cft_int16"))x->quantize = 1;
+	else if(!strcmp(arg1->s_name, "cft_float32"))x->quantize = 0;
+	else pd_error(x, "lsl_outlet~: -format %s: only cft_float32 and cft_int16 are supported", arg1->s_name);
+  	argc-=2, argv+=2;
+      }
+
+    // the same factors for every channel...
+    else if(!strcmp(arg1->s_name, "-scale") || !strcmp(arg1->s_name, "-offset"))
+      {
+	float *q = (arg1->s_name[1]=='s') ? x->q_scale : x->q_offset;
+	for(i=0;i<x->nchannels;i++)q[i] = atom_getfloatarg(1,argc,argv);
+  	argc-=2, argv+=2;
+      }
+
+    // ...or one channel at a time: -channel_scale <ch> <scale> <offset>
+    else if(!strcmp(arg1->s_name, "-channel_scale"))
+      {
+	i = atom_getfloatarg(1,argc,argv);
+	if(i<0 || i>=x->nchannels)
+	  pd_error(x, "lsl_outlet~: -channel_scale: no channel %d", i);
+	else{
+	  x->q_scale[i] = atom_getfloatarg(2,argc,argv);
+	  x->q_offset[i] = atom_getfloatarg(3,argc,argv);
+	}
+  	argc-=4, argv+=4;
+      }
+
+    else if(!strcmp(arg1->s_name, "-batch"))
+      {
+	lsl_outlet_tilde_batch(x, atom_getfloatarg(1,argc,argv));
+  	argc-=2, argv+=2;
+      }
+
+    else if(!strcmp(arg1->s_name, "-pushthrough"))
+      {
+	x->pushthrough = (atom_getfloatarg(1,argc,argv)!=0);
+  	argc-=2, argv+=2;
+      }
+
+    // only meaningful as creation arguments, they're consumed in lsl_outlet_tilde_new
+    else if(!strcmp(arg1->s_name, "-channels") || !strcmp(arg1->s_name, "-ring"))
+      argc-=2, argv+=2;
+
+    else{
+      pd_error(x, "lsl_outlet~: %s: unknown flag or argument missing", arg1->s_name);
+      argc--;
+      argv++;
+    }
+  }
+
+  // we only go if we know what to call the stream
+  if(!got_name){
+    pd_error(x, "lsl_outlet~: a stream needs a -name");
+    return -1;
+  }
+  return create_outlet(x);
+}
+
+// the caller has to hold push_lock (or know the sender isn't running)
+// since the decimator is rebuilt to match the stream
+static int create_outlet(t_lsl_outlet_tilde *x){
+
+  lsl_streaminfo info;
+  double srate = x->sr;
+  int chunk = sys_getblksize();
+  int i;
+
+  if(!pdlsl_lib_load(x))return -1;
+  free_decimator(x);
+  if(x->srate_out!=0 && x->srate_out!=x->sr){
+    if(setup_decimator(x)!=0)return -1;
+    srate = x->sr * x->dec.L / x->dec.M;
+    chunk = 1 + chunk * x->dec.L / x->dec.M;
+  }
+
+  if(x->quantize){
+    for(i=0;i<x->nchannels;i++){
+      if(x->q_scale[i]==0){
+	pd_error(x, "lsl_outlet~: channel %d: a scale of 0 can't be quantized", i);
+	return -1;
+      }
+      x->q_inv[i] = 1.0 / x->q_scale[i];
+    }
+  }
+
+  info = lsl_create_streaminfo(x->stream_name, x->stream_type, x->nchannels, srate,
+			       x->quantize ? cft_int16 : cft_float32, x->source_id);
+  if(x->quantize)write_scale_desc(x, info);
+  // one dsp block is one chunk on the wire
+  x->lsl_outlet_obj = lsl_create_outlet(info, chunk, 360);
+  lsl_destroy_streaminfo(info);
+  return (x->lsl_outlet_obj==NULL)?-1:0;
+}
+
+// <channels><channel><scale/><offset/></channel>...</channels>, the
+// same layout lsl_inlet~ looks for when it connects to an int16 stream
+static void write_scale_desc(t_lsl_outlet_tilde *x, lsl_streaminfo info){
+
+  lsl_xml_ptr chns, chn;
+  char val[32];
+  int i;
+
+  chns = lsl_append_child(lsl_get_desc(info), "channels");
+  for(i=0;i<x->nchannels;i++){
+    chn = lsl_append_child(chns, "channel");
+    sprintf(val, "%.9g", x->q_scale[i]);
+    lsl_append_child_value(chn, "scale", val);
+    sprintf(val, "%.9g", x->q_offset[i]);
+    lsl_append_child_value(chn, "offset", val);
+  }
+}
+
+// interleaved floats into q_buf, rounded and clipped to 16 bits
+static void quantize_frames(t_lsl_outlet_tilde *x, float *in, int frames){
+
+  int nch = x->nchannels;
+  int i, ch;
+  float v;
+  short *out = x->q_buf;
+
+  for(i=0;i<frames;i++){
+    for(ch=0;ch<nch;ch++){
+      v = (*in++ - x->q_offset[ch]) * x->q_inv[ch];
+      v = (v<0) ? v - 0.5f : v + 0.5f;
+      if(v>32767)v = 32767;
+      else if(v<-32768)v = -32768;
+      *out++ = (short)v;
+    }
+  }
+}
+
+static int gcd(int a, int b){
+
+  int t;
+  while(b!=0){
+    t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// windowed-sinc lowpass (blackman) with its cutoff at the lower of the
+// two nyquist frequencies and a transition band of 20% of the output
+// rate, aliasing only lands in that transition band
+static int setup_decimator(t_lsl_outlet_tilde *x){
+
+  t_decimator *d = &x->dec;
+  int in_rate = (int)(x->sr + 0.5);
+  int out_rate = (int)(x->srate_out + 0.5);
+  int g, D, N, n, p, k;
+  double fc, c, w, sum;
+  double *proto;
+
+  if(out_rate<1 || out_rate>in_rate){
+    pd_error(x, "lsl_outlet~: -srate %g: only decimation to a rate between 1 and %d is supported",
+	     x->srate_out, in_rate);
+    return -1;
+  }
+  g = gcd(in_rate, out_rate);
+  d->L = out_rate / g;
+  d->M = in_rate / g;
+  if(d->L > MAX_INTERP){
+    pd_error(x, "lsl_outlet~: -srate %g: %d/%d is too fine a ratio, try a rate that divides %d more evenly",
+	     x->srate_out, d->L, d->M, in_rate);
+    return -1;
+  }
+
+  D = (d->L > d->M) ? d->L : d->M;
+  fc = 0.5 / D;                                  // in cycles per upsampled sample
+  d->K = (int)ceil(5.5 * D / (0.2 * d->L));      // blackman: transition ~ 5.5/N
+  N = d->K * d->L;
+
+  proto = (double *)t_getbytes(sizeof(double) * N);
+  sum = 0;
+  for(n=0;n<N;n++){
+    c = n - 0.5 * (N - 1);
+    w = 0.42 - 0.5 * cos(2 * M_PI * n / (N - 1)) + 0.08 * cos(4 * M_PI * n / (N - 1));
+    proto[n] = w * ((c==0) ? 2 * fc : sin(2 * M_PI * fc * c) / (M_PI * c));
+    sum += proto[n];
+  }
+
+  // each phase ends up with unity gain at DC, that takes care of the
+  // zeros the upsampling would have stuffed in
+  d->h = (float *)t_getbytes(sizeof(float) * N);
+  for(p=0;p<d->L;p++)
+    for(k=0;k<d->K;k++)
+      d->h[p * d->K + (d->K - 1 - k)] = (float)(proto[p + k * d->L] * d->L / sum);
+  t_freebytes(proto, sizeof(double) * N);
+
+  d->hist = (float *)t_getbytes(sizeof(float) * x->nchannels * 2 * d->K);
+  memset(d->hist, 0, sizeof(float) * x->nchannels * 2 * d->K);
+  d->hpos = 0;
+  d->next_up = 0;
+  d->in_count = 0;
+  d->outlen = 2 + x->ringlen * d->L / d->M;
+  d->out = (float *)t_getbytes(sizeof(float) * x->nchannels * d->outlen);
+  d->delay = 0.5 * (N - 1) / (x->sr * d->L);
+  x->decimate = 1;
+
+  post("lsl_outlet~: resampling %d -> %d Hz (%d/%d, %d taps per phase)",
+       in_rate, out_rate, d->L, d->M, d->K);
+  return 0;
+}
+
+static void free_decimator(t_lsl_outlet_tilde *x){
+
+  t_decimator *d = &x->dec;
+
+  if(!x->decimate)return;
+  t_freebytes(d->h, sizeof(float) * d->L * d->K);
+  t_freebytes(d->hist, sizeof(float) * x->nchannels * 2 * d->K);
+  t_freebytes(d->out, sizeof(float) * x->nchannels * d->outlen);
+  x->decimate = 0;
+}
+
+static void reset_decimator(t_lsl_outlet_tilde *x){
+
+  t_decimator *d = &x->dec;
+
+  memset(d->hist, 0, sizeof(float) * x->nchannels * 2 * d->K);
+  d->hpos = 0;
+  d->next_up = 0;
+  d->in_count = 0;
+}
+
+// run interleaved input frames through the filter, returns the number
+// of output frames written to dec.out
+static int decimate_frames(t_lsl_outlet_tilde *x, float *in, int frames){
+
+  t_decimator *d = &x->dec;
+  int nch = x->nchannels;
+  int i, ch, k, nout = 0;
+  float *hist, *win, *h;
+  float acc;
+
+  for(i=0;i<frames;i++, in+=nch){
+    for(ch=0;ch<nch;ch++){
+      hist = d->hist + ch * 2 * d->K;
+      hist[d->hpos] = hist[d->hpos + d->K] = in[ch];
+    }
+    d->hpos = (d->hpos + 1 == d->K) ? 0 : d->hpos + 1;
+    d->in_count += 1;
+
+    // every output whose newest input sample has now arrived
+    while(floor(d->next_up / d->L) <= d->in_count - 1 && nout < d->outlen){
+      h = d->h + ((int)fmod(d->next_up, d->L)) * d->K;
+      for(ch=0;ch<nch;ch++){
+	win = d->hist + ch * 2 * d->K + d->hpos; // oldest to newest
+	acc = 0;
+	for(k=0;k<d->K;k++)acc += h[k] * win[k];
+	d->out[nout * nch + ch] = acc;
+      }
+      nout++;
+      d->next_up += d->M;
+    }
+  }
+  return nout;
+}
+
+// the sender has to be stopped while the ring is resized
+static void setup_ring(t_lsl_outlet_tilde *x, int blksize){
+
+  free_ring(x);
+  x->blksize = blksize;
+  x->ringlen = blksize * x->ring_blocks;
+  x->ring = (float *)t_getbytes(sizeof(float) * x->nchannels * x->ringlen);
+  x->ts_ring = (double *)t_getbytes(sizeof(double) * x->ring_blocks);
+  x->q_buf = (short *)t_getbytes(sizeof(short) * x->nchannels * (x->ringlen + 2));
+  x->wcount = x->rcount = 0;
+}
+
+static void free_ring(t_lsl_outlet_tilde *x){
+
+  if(x->ring!=NULL){
+    t_freebytes(x->ring, sizeof(float) * x->nchannels * x->ringlen);
+    t_freebytes(x->ts_ring, sizeof(double) * x->ring_blocks);
+    t_freebytes(x->q_buf, sizeof(short) * x->nchannels * (x->ringlen + 2));
+    x->ring = NULL;
+    x->ts_ring = NULL;
+    x->q_buf = NULL;
+  }
+}
+
+// sender thread:
+// waits until at least batch frames have piled up and pushes everything
+// that is contiguous in the ring with a single call
+static void *lsl_sender_thread(void *in){
+
+  t_lsl_outlet_tilde *x = (t_lsl_outlet_tilde *)in;
+  unsigned long avail;
+  int start, frames, last, nout, consumers;
+  double ts;
+  float *src;
+
+  while(x->stop_==0){
+    if(lsl_local_clock() >= x->next_poll){
+      pthread_mutex_lock(&x->push_lock);
+      consumers = x->lsl_outlet_obj!=NULL && lsl_have_consumers(x->lsl_outlet_obj);
+      // the filter's history is stale after a pause
+      if(consumers && !x->consumers && x->decimate)reset_decimator(x);
+      pthread_mutex_unlock(&x->push_lock);
+      x->consumers = consumers;
+      x->next_poll = lsl_local_clock() + CONSUMER_POLL;
+    }
+
+    avail = x->wcount - x->rcount;
+    if(avail==0 || (int)avail < x->batch){
+      sleep_ms(1);
+      continue;
+    }
+    memory_barrier();
+
+    start = x->rcount % x->ringlen;
+    frames = (int)avail;
+    if(start + frames > x->ringlen)frames = x->ringlen - start;
+
+    // stamp of the last frame we push, counted back from the end of its block
+    last = start + frames - 1;
+    ts = x->ts_ring[last / x->blksize] - (double)(x->blksize - 1 - last % x->blksize)/x->sr;
+
+    pthread_mutex_lock(&x->push_lock);
+    if(x->lsl_outlet_obj!=NULL){
+      if(x->decimate){
+	nout = decimate_frames(x, x->ring + start * x->nchannels, frames);
+	src = x->dec.out;
+	// the last output sits at input position (next_up - M)/L, shifted
+	// back by the filter's group delay
+	ts -= ((x->dec.in_count - 1) - (x->dec.next_up - x->dec.M) / x->dec.L) / x->sr + x->dec.delay;
+      }
+      else{
+	nout = frames;
+	src = x->ring + start * x->nchannels;
+      }
+      if(nout>0 && x->quantize){
+	quantize_frames(x, src, nout);
+	lsl_push_chunk_stp(x->lsl_outlet_obj, x->q_buf, nout * x->nchannels, ts, x->pushthrough);
+      }
+      else if(nout>0)
+	lsl_push_chunk_ftp(x->lsl_outlet_obj, src, nout * x->nchannels, ts, x->pushthrough);
+    }
+    pthread_mutex_unlock(&x->push_lock);
+
+    memory_barrier();
+    x->rcount += frames;
+  }
+  return NULL;
+}
+
+// the sender keeps reading lsl_local_clock, so it waits for the first outlet
+static void start_sender(t_lsl_outlet_tilde *x){
+
+  if(x->running || !pdlsl_lib_loaded())return;
+  x->stop_ = 0;
+  if(pthread_create(&x->tid, NULL, lsl_sender_thread, (void *)x)!=0){
+    pd_error(x, "lsl_outlet~: error launching sender thread");
+    return;
+  }
+  x->running = 1;
+}
+
+static void stop_sender(t_lsl_outlet_tilde *x){
+
+  if(!x->running)return;
+  x->stop_ = 1;
+  pthread_join(x->tid, NULL);
+  x->running = 0;
+}
+
+// the drop counter is only ever written by the perform routine, here we
+// just look at it now and then and complain if it moved
+static void lsl_outlet_tilde_report(t_lsl_outlet_tilde *x){
+
+  t_atom at;
+  unsigned long dropped = x->dropped;
+
+  if(x->consumers != x->consumers_reported){
+    x->consumers_reported = x->consumers;
+    SETFLOAT(&at, (t_float)x->consumers_reported);
+    outlet_anything(x->info_outlet, gensym("consumers"), 1, &at);
+  }
+
+  if(dropped != x->reported){
+    pd_error(x, "lsl_outlet~: %s: the network side fell behind, dropped %lu blocks",
+	     x->stream_name, dropped - x->reported);
+    x->reported = dropped;
+    SETFLOAT(&at, (t_float)dropped);
+    outlet_anything(x->info_outlet, gensym("dropped"), 1, &at);
+  }
+  clock_delay(x->report_clock, REPORT_INTERVAL);
+}
+
+// pd computes blocks ahead of real time in bursts, so the lsl time of a
+// block comes from a slowly smoothed mapping of pd's logical time onto
+// lsl_local_clock rather than from the clock read itself. the mapping is
+// refined from a pd clock every SYNC_INTERVAL ms, the perform routine only
+// reads it
+static void lsl_outlet_tilde_sync(t_lsl_outlet_tilde *x){
+
+  double raw = lsl_local_clock() - clock_gettimesince(x->clk_anchor) * 0.001;
+
+  if(!x->clk_valid){
+    x->clk_offset = raw;
+    x->clk_valid = 1;
+  }
+  else x->clk_offset += 0.02 * (raw - x->clk_offset);
+  clock_delay(x->sync_clock, SYNC_INTERVAL);
+}
+
+// pd has already moved its logical time past the block being computed,
+// so this is the lsl time just after the block's last sample
+static double block_lsl_time(t_lsl_outlet_tilde *x){
+
+  return clock_gettimesince(x->clk_anchor) * 0.001 + x->clk_offset;
+}
+
+// dsp
+// the audio thread never calls into liblsl, it only copies the block
+// into the ring (or counts it as dropped if the sender fell behind)
+static t_int *lsl_outlet_tilde_perform(t_int *w){
+
+  t_lsl_outlet_tilde *x = (t_lsl_outlet_tilde *)(w[1]);
+  int n = (int)(w[x->nchannels + 2]);
+  int i, j, start;
+  unsigned long wcount = x->wcount;
+  t_sample *in;
+  float *frame;
+
+  if(x->outlet_established!=1 || !x->consumers || !x->clk_valid)
+    return (w + x->nchannels + 3);
+
+  if(x->ringlen - (int)(wcount - x->rcount) < n){
+    x->dropped++;
+    return (w + x->nchannels + 3);
+  }
+
+  start = wcount % x->ringlen;
+  for(i=0;i<x->nchannels;i++){
+    in = (t_sample *)(w[i + 2]);
+    frame = x->ring + start * x->nchannels + i;
+    for(j=0;j<n;j++, frame+=x->nchannels)*frame = in[j];
+  }
+
+  // the stamp belongs to the last sample of the block, liblsl deduces the rest
+  x->ts_ring[start / n] = block_lsl_time(x) - 1.0/x->sr + x->latency * 0.001;
+
+  memory_barrier();
+  x->wcount = wcount + n;
+
+  return (w + x->nchannels + 3);
+}
+
+static void lsl_outlet_tilde_dsp(t_lsl_outlet_tilde *x, t_signal **sp){
+
+  int i;
+  t_int *vec;
+
+  // nothing is being performed right now, so the sender can be stopped
+  // while we reshape the ring and maybe the outlet
+  stop_sender(x);
+  if(sp[0]->s_n != x->blksize){
+    setup_ring(x, sp[0]->s_n);
+    // the decimator's output buffer is sized by the ring
+    if(x->decimate){
+      free_decimator(x);
+      setup_decimator(x);
+    }
+  }
+  else x->wcount = x->rcount = 0;
+
+  // the stream's nominal rate has to follow pd's
+  if(sp[0]->s_sr != x->sr){
+    x->sr = sp[0]->s_sr;
+    if(x->lsl_outlet_obj!=NULL){
+      post("lsl_outlet~: sampling rate changed to %g, recreating outlet %s", x->sr, x->stream_name);
+      lsl_destroy_outlet(x->lsl_outlet_obj);
+      x->outlet_established = (create_outlet(x)==0);
+      x->next_poll = 0;
+    }
+  }
+  start_sender(x);
+
+  vec = (t_int *)t_getbytes(sizeof(t_int) * (x->nchannels + 2));
+  vec[0] = (t_int)x;
+  for(i=0;i<x->nchannels;i++)vec[i+1] = (t_int)sp[i]->s_vec;
+  vec[x->nchannels+1] = (t_int)sp[0]->s_n;
+  dsp_addv(lsl_outlet_tilde_perform, x->nchannels + 2, vec);
+  t_freebytes(vec, sizeof(t_int) * (x->nchannels + 2));
+}
+
+// lsl methods
+void lsl_outlet_tilde_create_outlet(t_lsl_outlet_tilde *x, t_symbol *s, int argc, t_atom *argv){
+  int res;
+  x->outlet_established = 0;
+  pthread_mutex_lock(&x->push_lock);
+  if(x->lsl_outlet_obj!=NULL){
+    lsl_destroy_outlet(x->lsl_outlet_obj);
+    x->lsl_outlet_obj=NULL;
+  }
+  res = parse_and_create_outlet(x, argc, argv);
+  x->consumers = 0;
+  x->next_poll = 0;
+  pthread_mutex_unlock(&x->push_lock);
+  if(res==0){
+    // liblsl is loaded now, so the clock mapping can start
+    if(!x->clk_valid)lsl_outlet_tilde_sync(x);
+    x->outlet_established = 1;
+    start_sender(x);
+  }
+  else x->outlet_established = 0;
+  outlet_float(x->f_outlet, x->outlet_established);
+}
+
+void lsl_outlet_tilde_destroy_outlet(t_lsl_outlet_tilde *x){
+
+  pthread_mutex_lock(&x->push_lock);
+  if(x->lsl_outlet_obj!=NULL){
+    x->outlet_established=0;
+    lsl_destroy_outlet(x->lsl_outlet_obj);
+    x->lsl_outlet_obj = NULL;
+  }
+  x->consumers = 0;
+  pthread_mutex_unlock(&x->push_lock);
+  outlet_float(x->f_outlet, x->outlet_established);
+}
+
+// minimum number of samples the sender collects before pushing,
+// larger batches trade latency for fewer (bigger) network transfers
+void lsl_outlet_tilde_batch(t_lsl_outlet_tilde *x, t_floatarg f){
+
+  x->batch = (f<1)?1:(int)f;
+  if(x->batch > x->ringlen / 2){
+    x->batch = x->ringlen / 2;
+    post("lsl_outlet~: batch clipped to half the ring (%d samples)", x->batch);
+  }
+}
+
+// 1 sends every push right away, 0 lets liblsl gather chunks for throughput
+void lsl_outlet_tilde_pushthrough(t_lsl_outlet_tilde *x, t_floatarg f){
+
+  x->pushthrough = (f!=0);
+}
+
+void lsl_outlet_tilde_stats(t_lsl_outlet_tilde *x){
+
+  t_atom at[2];
+
+  SETFLOAT(at, (t_float)x->dropped);
+  outlet_anything(x->info_outlet, gensym("dropped"), 1, at);
+  SETFLOAT(at, (t_float)(x->wcount - x->rcount));
+  SETFLOAT(at+1, (t_float)x->ringlen);
+  outlet_anything(x->info_outlet, gensym("queued"), 2, at);
+}
+
+void lsl_outlet_tilde_have_consumers(t_lsl_outlet_tilde *x){
+
+  t_atom at;
+
+  SETFLOAT(&at, (t_float)x->consumers);
+  outlet_anything(x->info_outlet, gensym("consumers"), 1, &at);
+}
+
+void lsl_outlet_tilde_is_outlet_established(t_lsl_outlet_tilde *x){
+
+  outlet_float(x->f_outlet, x->outlet_established);
+}
+
+// calibrated delay between pd's logical time and the sound leaving the speaker
+void lsl_outlet_tilde_latency(t_lsl_outlet_tilde *x, t_floatarg f){
+
+  x->latency = f;
+}
+
+void *lsl_outlet_tilde_new(t_symbol *s, int argc, t_atom *argv){
+
+  int i;
+  t_lsl_outlet_tilde *x = (t_lsl_outlet_tilde *)pd_new(lsl_outlet_tilde_class);
+
+  // the channel count decides how many inlets we have and the ring is
+  // sized by it, so these have to be known up front
+  x->nchannels = 1;
+  x->ring_blocks = 64;
+  x->batch = 1;
+  x->pushthrough = 1;
+  for(i=0;i<argc-1;i++){
+    if(!strcmp(atom_getsymbolarg(i, argc, argv)->s_name, "-channels")){
+      x->nchannels = atom_getfloatarg(i+1, argc, argv);
+      if(x->nchannels<1)x->nchannels = 1;
+    }
+    else if(!strcmp(atom_getsymbolarg(i, argc, argv)->s_name, "-ring")){
+      x->ring_blocks = atom_getfloatarg(i+1, argc, argv);
+      if(x->ring_blocks<2)x->ring_blocks = 2;
+    }
+  }
+
+  for(i=1;i<x->nchannels;i++)
+    inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
+  x->f_outlet = outlet_new(&x->x_obj, &s_float);
+  x->info_outlet = outlet_new(&x->x_obj, 0);
+
+  x->f = 0;
+  x->sr = sys_getsr();
+  x->srate_out = 0;
+  x->decimate = 0;
+  x->ring = NULL;
+  x->ts_ring = NULL;
+  x->q_buf = NULL;
+  x->blksize = 0;
+
+  // full scale -1..1 by default
+  x->quantize = 0;
+  x->q_scale = (float *)t_getbytes(sizeof(float) * x->nchannels);
+  x->q_offset = (float *)t_getbytes(sizeof(float) * x->nchannels);
+  x->q_inv = (float *)t_getbytes(sizeof(float) * x->nchannels);
+  for(i=0;i<x->nchannels;i++){
+    x->q_scale[i] = 1.0 / 32767;
+    x->q_offset[i] = 0;
+  }
+  setup_ring(x, sys_getblksize());
+  x->dropped = x->reported = 0;
+  x->report_clock = clock_new(x, (t_method)lsl_outlet_tilde_report);
+  clock_delay(x->report_clock, REPORT_INTERVAL);
+
+  pthread_mutex_init(&x->push_lock, NULL);
+  x->running = 0;
+  x->stop_ = 1;
+  x->consumers = 0;
+  x->consumers_reported = 0;
+  x->next_poll = 0;
+
+  x->lsl_outlet_obj = NULL;
+  x->outlet_established = 0;
+
+  x->latency = 0;
+  x->clk_anchor = clock_getlogicaltime();
+  x->clk_valid = 0;
+  x->sync_clock = clock_new(x, (t_method)lsl_outlet_tilde_sync);
+
+  // anything beyond the creation-only flags means we create the outlet right away
+  for(i=0;i<argc;i+=2)
+    if(strcmp(atom_getsymbolarg(i, argc, argv)->s_name, "-channels") &&
+       strcmp(atom_getsymbolarg(i, argc, argv)->s_name, "-ring")){
+      lsl_outlet_tilde_create_outlet(x, s, argc, argv);
+      break;
+    }
+  return x;
+}
+
+void lsl_outlet_tilde_free(t_lsl_outlet_tilde *x){
+
+  stop_sender(x);
+  if(x->lsl_outlet_obj!=NULL)lsl_destroy_outlet(x->lsl_outlet_obj);
+  free_decimator(x);
+  free_ring(x);
+  t_freebytes(x->q_scale, sizeof(float) * x->nchannels);
+  t_freebytes(x->q_offset, sizeof(float) * x->nchannels);
+  t_freebytes(x->q_inv, sizeof(float) * x->nchannels);
+  clock_free(x->report_clock);
+  clock_free(x->sync_clock);
+  pthread_mutex_destroy(&x->push_lock);
+}
+
+void lsl_outlet_tilde_setup(void){
+
+  lsl_outlet_tilde_class = class_new(gensym("lsl_outlet~"),
+				     (t_newmethod)lsl_outlet_tilde_new,
+				     (t_method)lsl_outlet_tilde_free,
+				     sizeof(t_lsl_outlet_tilde),
+				     0,
+				     A_GIMME,
+				     0);
+
+  CLASS_MAINSIGNALIN(lsl_outlet_tilde_class, t_lsl_outlet_tilde, f);
+
+  class_addmethod(lsl_outlet_tilde_class,
+		  (t_method)lsl_outlet_tilde_dsp,
+		  gensym("dsp"),
+		  0);
+
+  class_addmethod(lsl_outlet_tilde_class,
+		  (t_method)lsl_outlet_tilde_create_outlet,
+		  gensym("create_outlet"),
+		  A_GIMME,
+		  0);
+
+  class_addmethod(lsl_outlet_tilde_class,
+		  (t_method)lsl_outlet_tilde_latency,
+		  gensym("latency"),
+		  A_FLOAT,
+		  0);
+
+  class_addmethod(lsl_outlet_tilde_class,
+		  (t_method)lsl_outlet_tilde_have_consumers,
+		  gensym("have_consumers"),
+		  0);
+
+  class_addmethod(lsl_outlet_tilde_class,
+		  (t_method)lsl_outlet_tilde_batch,
+		  gensym("batch"),
+		  A_FLOAT,
+		  0);
+
+  class_addmethod(lsl_outlet_tilde_class,
+		  (t_method)lsl_outlet_tilde_pushthrough,
+		  gensym("pushthrough"),
+		  A_FLOAT,
+		  0);
+
+  class_addmethod(lsl_outlet_tilde_class,
+		  (t_method)lsl_outlet_tilde_stats,
+		  gensym("stats"),
+		  0);
+
+  class_addmethod(lsl_outlet_tilde_class,
+		  (t_method)lsl_outlet_tilde_destroy_outlet,
+		  gensym("destroy_outlet"),
+		  0);
+
+  class_addmethod(lsl_outlet_tilde_class,
+		  (t_method)lsl_outlet_tilde_is_outlet_established,
+		  gensym("is_outlet_established"),
+		  0);
+
+}
@@ -0,0 +1,641 @@
+/*************** lsl_publisher *************/
+/* Written by David Medine on behalf of    */
+/* Brain Products                          */
+/* 15/5/2017                               */
+/* Released under the GPL                  */
+/* This software is free and open source   */
+/*******************************************/
+
+
+#include "m_pd.h"
+#include "pdlsl_lib.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "pthread.h"
+
+#ifdef _WIN32
+#include "windows.h"
+#define sleep_ms(ms) Sleep(ms)
+#else
+#include <unistd.h>
+#define sleep_ms(ms) usleep((ms)*1000)
+#endif
+
+#define HASHSIZE        64     // buckets of the stream table, the chains grow as needed
+#define STR_FIELD       32     // room for the text of one float in a string stream
+#define CONSUMER_POLL   0.2    // s between checks for consumers of each stream
+#define REPORT_INTERVAL 250    // ms between checks of the drop counters
+#define SYNC_INTERVAL   50     // ms between refinements of the logical time mapping
+
+// one outlet of the table. pd fills pend (under the lock), the sender
+// swaps it with send when it is due and pushes send without the lock
+typedef struct _pub_stream{
+  t_symbol                *name;               // also the key of the table
+  lsl_outlet              outlet;
+  lsl_channel_format_t    cft;
+  int                     nchannels;
+  int                     size;                // bytes per value
+  int                     chunk_size;          // samples that make a push due right away
+  int                     capacity;            // samples pend can hold
+
+  char                    *pend, *send;        // capacity * nchannels values each
+  char                    *pend_str, *send_str; // text of numbers for string streams
+  double                  *pend_ts, *send_ts;
+  int                     npend, nsend;
+  double                  first;               // lsl_local_clock when the oldest pending sample came in
+
+  volatile int            consumers;
+  double                  next_poll;           // sender only
+  int                     poll;                // sender only
+  int                     busy;                // the sender is working on it outside the lock
+  unsigned long           dropped;             // pend was full (pd thread only)
+  unsigned long           reported;
+
+  struct _pub_stream      *next;               // in its bucket
+  struct _pub_stream      *next_send;          // in the sender's list of one pass
+}t_pub_stream;
+
+// pd boilerplate:
+static t_class *lsl_publisher_class;
+
+typedef struct _lsl_publisher{
+
+  t_object    x_obj;
+  t_outlet    *info_outlet;
+
+  t_pub_stream    *table[HASHSIZE];
+  int             nstreams;
+
+  // one thread does all the pushing (and consumer polling) for every stream
+  pthread_t       tid;
+  pthread_mutex_t lock;             // the table's chains and every stream's pend side
+  int             stop_;
+  int             running;
+  double          flush_interval;   // ms a sample may wait for more to share its push
+
+  t_clock         *report_clock;
+
+  // mapping of pd's logical time onto the lsl clock for timestamping
+  t_clock         *sync_clock;
+  double          clk_anchor;
+  double          clk_offset;
+  int             clk_valid;
+  double          latency;          // ms added to every stamp
+
+}t_lsl_publisher;
+
+// helper function declarations:
+static int pub_hash(t_symbol *s);
+static t_pub_stream *find_stream(t_lsl_publisher *x, t_symbol *name);
+static t_pub_stream *new_stream(t_lsl_publisher *x, t_symbol *name, int argc, t_atom *argv);
+static void free_stream(t_lsl_publisher *x, t_pub_stream *st);
+static void unlink_stream(t_lsl_publisher *x, t_pub_stream *st);
+static int format_size(lsl_channel_format_t cft);
+static void store_value(lsl_channel_format_t cft, char *buf, int i, double v);
+static void push_chunk(t_pub_stream *st, char *buf, int n, double *ts);
+static double logical_lsl_time(t_lsl_publisher *x);
+static void lsl_publisher_sync(t_lsl_publisher *x);
+static void start_sender(t_lsl_publisher *x);
+static void stop_sender(t_lsl_publisher *x);
+
+// the table is keyed by the symbol pointer, pd makes every name unique
+static int pub_hash(t_symbol *s){
+
+  return (int)(((size_t)s >> 3) % HASHSIZE);
+}
+
+static t_pub_stream *find_stream(t_lsl_publisher *x, t_symbol *name){
+
+  t_pub_stream *st;
+
+  for(st=x->table[pub_hash(name)];st!=NULL;st=st->next)
+    if(st->name==name)return st;
+  return NULL;
+}
+
+static int format_size(lsl_channel_format_t cft){
+
+  switch(cft){
+  case cft_float32: return sizeof(float);
+  case cft_double64: return sizeof(double);
+  case cft_int32: return sizeof(int);
+  case cft_int16: return sizeof(short);
+  case cft_int8: return sizeof(char);
+  case cft_string: return sizeof(char *);
+  default: return 0;
+  }
+}
+
+// element i of a buffer of numbers in format cft
+static void store_value(lsl_channel_format_t cft, char *buf, int i, double v){
+
+  switch(cft){
+  case cft_float32: ((float *)buf)[i] = v; break;
+  case cft_double64: ((double *)buf)[i] = v; break;
+  case cft_int32:
+    if(v>2147483647.)v = 2147483647.;
+    else if(v<-2147483648.)v = -2147483648.;
+    ((int *)buf)[i] = (int)v;
+    break;
+  case cft_int16:
+    if(v>32767)v = 32767;
+    else if(v<-32768)v = -32768;
+    ((short *)buf)[i] = (short)v;
+    break;
+  case cft_int8:
+    if(v>127)v = 127;
+    else if(v<-128)v = -128;
+    ((char *)buf)[i] = (char)v;
+    break;
+  default: break;
+  }
+}
+
+// n samples, one stamp each
+static void push_chunk(t_pub_stream *st, char *buf, int n, double *ts){
+
+  unsigned long len = n * st->nchannels;
+
+  switch(st->cft){
+  case cft_float32: lsl_push_chunk_ftn(st->outlet, (float *)buf, len, ts); break;
+  case cft_double64: lsl_push_chunk_dtn(st->outlet, (double *)buf, len, ts); break;
+  case cft_int32: lsl_push_chunk_itn(st->outlet, (int *)buf, len, ts); break;
+  case cft_int16: lsl_push_chunk_stn(st->outlet, (short *)buf, len, ts); break;
+  case cft_int8: lsl_push_chunk_ctn(st->outlet, buf, len, ts); break;
+  case cft_string: lsl_push_chunk_strtn(st->outlet, (char **)buf, len, ts); break;
+  default: break;
+  }
+}
+
+// add <name> [-type <type>] [-format <cft_...>] [-channels <n>] [-id <source_id>] [-chunk_size <n>]
+static t_pub_stream *new_stream(t_lsl_publisher *x, t_symbol *name, int argc, t_atom *argv){
+
+  t_pub_stream *st;
+  t_symbol *arg1, *arg2;
+  lsl_streaminfo info;
+  char *type = "pd_lsl";
+  char *source_id = "";
+  lsl_channel_format_t cft = cft_float32;
+  int nchannels = 1;
+  int chunk_size = 1;
+  int values;
+
+  while(argc > 0) {
+    arg1 = atom_getsymbolarg(0, argc, argv);
+    arg2 = atom_getsymbolarg(1, argc, argv);
+    if(!strcmp(arg1->s_name, "-type"))type = arg2->s_name;
+    else if(!strcmp(arg1->s_name, "-id"))source_id = arg2->s_name;
+    else if(!strcmp(arg1->s_name, "-channels"))nchannels = atom_getfloatarg(1, argc, argv);
+    else if(!strcmp(arg1->s_name, "-chunk_size"))chunk_size = atom_getfloatarg(1, argc, argv);
+    else if(!strcmp(arg1->s_name, "-format")){
+      if(!strcmp(arg2->s_name, "cft_float32"))cft = cft_float32;
+      else if(!strcmp(arg2->s_name, "cft_double64"))cft = cft_double64;
+      else if(!strcmp(arg2->s_name, "cft_int32"))cft = cft_int32;
+      else if(!strcmp(arg2->s_name, "cft_int16"))cft = cft_int16;
+      else if(!strcmp(arg2->s_name, "cft_int8"))cft = cft_int8;
+      else if(!strcmp(arg2->s_name, "cft_string"))cft = cft_string;
+      else {pd_error(x, "lsl_publisher: invalid channel type: %s", arg2->s_name); return NULL;}
+    }
+    else{
+      pd_error(x, "lsl_publisher: %s: unknown flag or argument missing", arg1->s_name);
+      argc--, argv++;
+      continue;
+    }
+    argc-=2, argv+=2;
+  }
+  if(nchannels<1)nchannels = 1;
+  if(chunk_size<1)chunk_size = 1;
+
+  st = (t_pub_stream *)t_getbytes(sizeof(t_pub_stream));
+  st->name = name;
+  st->cft = cft;
+  st->nchannels = nchannels;
+  st->size = format_size(cft);
+  st->chunk_size = chunk_size;
+  // room for a few chunks in case the sender is slow to come around
+  st->capacity = (4 * chunk_size < 64) ? 64 : 4 * chunk_size;
+  values = st->capacity * nchannels;
+  st->pend = (char *)t_getbytes(values * st->size);
+  st->send = (char *)t_getbytes(values * st->size);
+  st->pend_ts = (double *)t_getbytes(st->capacity * sizeof(double));
+  st->send_ts = (double *)t_getbytes(st->capacity * sizeof(double));
+  st->pend_str = st->send_str = NULL;
+  if(cft==cft_string){
+    st->pend_str = (char *)t_getbytes(values * STR_FIELD);
+    st->send_str = (char *)t_getbytes(values * STR_FIELD);
+  }
+  st->npend = st->nsend = 0;
+  st->consumers = 0;
+  st->next_poll = 0;
+  st->poll = 0;
+  st->busy = 0;
+  st->dropped = st->reported = 0;
+  st->next = st->next_send = NULL;
+
+  info = lsl_create_streaminfo(name->s_name, type, nchannels, 0, cft, source_id);
+  st->outlet = lsl_create_outlet(info, 0, 360);
+  lsl_destroy_streaminfo(info);
+  if(st->outlet==NULL){
+    pd_error(x, "lsl_publisher: %s: unable to create outlet", name->s_name);
+    free_stream(x, st);
+    return NULL;
+  }
+  return st;
+}
+
+// whatever is still pending goes out before the outlet does
+static void free_stream(t_lsl_publisher *x, t_pub_stream *st){
+
+  int values = st->capacity * st->nchannels;
+
+  if(st->outlet!=NULL){
+    if(st->npend>0)push_chunk(st, st->pend, st->npend, st->pend_ts);
+    lsl_destroy_outlet(st->outlet);
+  }
+  t_freebytes(st->pend, values * st->size);
+  t_freebytes(st->send, values * st->size);
+  t_freebytes(st->pend_ts, st->capacity * sizeof(double));
+  t_freebytes(st->send_ts, st->capacity * sizeof(double));
+  if(st->pend_str!=NULL){
+    t_freebytes(st->pend_str, values * STR_FIELD);
+    t_freebytes(st->send_str, values * STR_FIELD);
+  }
+  t_freebytes(st, sizeof(t_pub_stream));
+}
+
+// takes the stream out of the table and waits until the sender lets go of it
+static void unlink_stream(t_lsl_publisher *x, t_pub_stream *st){
+
+  t_pub_stream **pp;
+
+  pthread_mutex_lock(&x->lock);
+  for(pp=&x->table[pub_hash(st->name)];*pp!=NULL;pp=&(*pp)->next)
+    if(*pp==st){
+      *pp = st->next;
+      break;
+    }
+  while(st->busy){
+    pthread_mutex_unlock(&x->lock);
+    sleep_ms(1);
+    pthread_mutex_lock(&x->lock);
+  }
+  pthread_mutex_unlock(&x->lock);
+  x->nstreams--;
+}
+
+// sender thread:
+// every ms, collect the streams that are due (a full chunk, or a sample
+// older than flush_interval) or due for a consumer check, then do the
+// liblsl work for all of them with the lock released
+static void *lsl_sender_thread(void *in){
+
+  t_lsl_publisher *x = (t_lsl_publisher *)in;
+  t_pub_stream *st, *list;
+  double now;
+  char *tmp;
+  double *tmp_ts;
+  int i;
+
+  while(x->stop_==0){
+    now = lsl_local_clock();
+    list = NULL;
+
+    pthread_mutex_lock(&x->lock);
+    for(i=0;i<HASHSIZE;i++)
+      for(st=x->table[i];st!=NULL;st=st->next){
+	if(st->npend>0 &&
+	   (st->npend >= st->chunk_size || (now - st->first) * 1000 >= x->flush_interval)){
+	  tmp = st->send; st->send = st->pend; st->pend = tmp;
+	  tmp = st->send_str; st->send_str = st->pend_str; st->pend_str = tmp;
+	  tmp_ts = st->send_ts; st->send_ts = st->pend_ts; st->pend_ts = tmp_ts;
+	  st->nsend = st->npend;
+	  st->npend = 0;
+	}
+	st->poll = (now >= st->next_poll);
+	if(st->nsend>0 || st->poll){
+	  st->busy = 1;
+	  st->next_send = list;
+	  list = st;
+	}
+      }
+    pthread_mutex_unlock(&x->lock);
+
+    for(st=list;st!=NULL;st=st->next_send){
+      if(st->nsend>0)push_chunk(st, st->send, st->nsend, st->send_ts);
+      if(st->poll){
+	st->consumers = lsl_have_consumers(st->outlet);
+	st->next_poll = now + CONSUMER_POLL;
+      }
+    }
+
+    if(list!=NULL){
+      pthread_mutex_lock(&x->lock);
+      for(st=list;st!=NULL;st=st->next_send){
+	st->nsend = 0;
+	st->busy = 0;
+      }
+      pthread_mutex_unlock(&x->lock);
+    }
+    sleep_ms(1);
+  }
+  return NULL;
+}
+
+static void start_sender(t_lsl_publisher *x){
+
+  if(x->running)return;
+  x->stop_ = 0;
+  if(pthread_create(&x->tid, NULL, lsl_sender_thread, (void *)x)!=0){
+    pd_error(x, "lsl_publisher: error launching sender thread");
+    return;
+  }
+  x->running = 1;
+}
+
+static void stop_sender(t_lsl_publisher *x){
+
+  if(!x->running)return;
+  x->stop_ = 1;
+  pthread_join(x->tid, NULL);
+  x->running = 0;
+}
+
+// clock mapping, the same as lsl_outlet's: samples are stamped with the
+// lsl time of the logical time they were pushed at
+static void lsl_publisher_sync(t_lsl_publisher *x){
+
+  double raw = lsl_local_clock() - clock_gettimesince(x->clk_anchor) * 0.001;
+
+  if(!x->clk_valid){
+    x->clk_offset = raw;
+    x->clk_valid = 1;
+  }
+  else x->clk_offset += 0.02 * (raw - x->clk_offset);
+  clock_delay(x->sync_clock, SYNC_INTERVAL);
+}
+
+static double logical_lsl_time(t_lsl_publisher *x){
+
+  if(!x->clk_valid)lsl_publisher_sync(x);
+  return clock_gettimesince(x->clk_anchor) * 0.001 + x->clk_offset + x->latency * 0.001;
+}
+
+// the drop counters are only written on pd's thread, complain now and then
+static void lsl_publisher_report(t_lsl_publisher *x){
+
+  t_pub_stream *st;
+  t_atom at[2];
+  int i;
+
+  for(i=0;i<HASHSIZE;i++)
+    for(st=x->table[i];st!=NULL;st=st->next)
+      if(st->dropped != st->reported){
+	pd_error(x, "lsl_publisher: %s: pushes came faster than they could be sent, dropped %lu",
+		 st->name->s_name, st->dropped - st->reported);
+	st->reported = st->dropped;
+	SETSYMBOL(at, st->name);
+	SETFLOAT(at+1, (t_float)st->dropped);
+	outlet_anything(x->info_outlet, gensym("dropped"), 2, at);
+      }
+  clock_delay(x->report_clock, REPORT_INTERVAL);
+}
+
+// pd methods:
+void lsl_publisher_add(t_lsl_publisher *x, t_symbol *s, int argc, t_atom *argv){
+
+  t_symbol *name = atom_getsymbolarg(0, argc, argv);
+  t_pub_stream *st;
+  t_atom at;
+  int h;
+
+  if(name==&s_){
+    pd_error(x, "lsl_publisher: add needs a stream name");
+    return;
+  }
+  if(find_stream(x, name)!=NULL){
+    pd_error(x, "lsl_publisher: there already is a stream called %s", name->s_name);
+    return;
+  }
+  if(!pdlsl_lib_load(x))return;
+  if((st = new_stream(x, name, argc-1, argv+1))==NULL)return;
+
+  h = pub_hash(name);
+  pthread_mutex_lock(&x->lock);
+  st->next = x->table[h];
+  x->table[h] = st;
+  pthread_mutex_unlock(&x->lock);
+  x->nstreams++;
+  start_sender(x);
+
+  SETSYMBOL(&at, name);
+  outlet_anything(x->info_outlet, gensym("added"), 1, &at);
+}
+
+void lsl_publisher_remove(t_lsl_publisher *x, t_symbol *name){
+
+  t_pub_stream *st = find_stream(x, name);
+  t_atom at;
+
+  if(st==NULL){
+    pd_error(x, "lsl_publisher: no stream called %s", name->s_name);
+    return;
+  }
+  unlink_stream(x, st);
+  free_stream(x, st);
+
+  SETSYMBOL(&at, name);
+  outlet_anything(x->info_outlet, gensym("removed"), 1, &at);
+}
+
+void lsl_publisher_clear(t_lsl_publisher *x){
+
+  t_pub_stream *st;
+  int i;
+
+  for(i=0;i<HASHSIZE;i++)
+    while((st = x->table[i])!=NULL){
+      unlink_stream(x, st);
+      free_stream(x, st);
+    }
+}
+
+// push <name> <values...>
+// the values are converted into the stream's pending buffer right here,
+// liblsl only ever gets called from the sender
+void lsl_publisher_push(t_lsl_publisher *x, t_symbol *s, int argc, t_atom *argv){
+
+  t_symbol *name = atom_getsymbolarg(0, argc, argv);
+  t_pub_stream *st = find_stream(x, name);
+  char *slot, *field;
+  int i, first;
+  double ts;
+
+  if(st==NULL){
+    pd_error(x, "lsl_publisher: no stream called %s", name->s_name);
+    return;
+  }
+  if(!st->consumers)return;
+  argc--, argv++;
+  ts = logical_lsl_time(x);
+
+  pthread_mutex_lock(&x->lock);
+  if(st->npend == st->capacity){
+    pthread_mutex_unlock(&x->lock);
+    st->dropped++;
+    return;
+  }
+  first = st->npend * st->nchannels;
+  slot = st->pend + first * st->size;
+  for(i=0;i<st->nchannels;i++){
+    if(st->cft==cft_string){
+      field = st->pend_str + (first + i) * STR_FIELD;
+      if(i<argc && argv[i].a_type==A_SYMBOL)
+	((char **)slot)[i] = argv[i].a_w.w_symbol->s_name;
+      else{
+	if(i<argc)atom_string(&argv[i], field, STR_FIELD);
+	else field[0] = '\0';
+	((char **)slot)[i] = field;
+      }
+    }
+    else store_value(st->cft, slot, i, (i<argc) ? atom_getfloat(&argv[i]) : 0);
+  }
+  if(st->npend==0)st->first = lsl_local_clock();
+  st->pend_ts[st->npend++] = ts;
+  pthread_mutex_unlock(&x->lock);
+}
+
+void lsl_publisher_list_streams(t_lsl_publisher *x){
+
+  t_pub_stream *st;
+  int i;
+
+  post("----------lsl_publisher streams (%d)------------", x->nstreams);
+  for(i=0;i<HASHSIZE;i++)
+    for(st=x->table[i];st!=NULL;st=st->next)
+      post("%s  |  %d channels  |  chunk %d  |  consumers: %d",
+	   st->name->s_name, st->nchannels, st->chunk_size, st->consumers);
+}
+
+// ms a sample may wait for others of its stream before it is sent
+void lsl_publisher_flush_interval(t_lsl_publisher *x, t_floatarg f){
+
+  x->flush_interval = (f<0) ? 0 : f;
+}
+
+// calibrated delay between pd's logical time and the stimulus
+void lsl_publisher_latency(t_lsl_publisher *x, t_floatarg f){
+
+  x->latency = f;
+}
+
+void *lsl_publisher_new(t_symbol *s, int argc, t_atom *argv){
+
+  t_symbol *arg1;
+  int i;
+  t_lsl_publisher *x = (t_lsl_publisher *)pd_new(lsl_publisher_class);
+
+  x->info_outlet = outlet_new(&x->x_obj, 0);
+
+  for(i=0;i<HASHSIZE;i++)x->table[i] = NULL;
+  x->nstreams = 0;
+  x->flush_interval = 0;
+  x->latency = 0;
+
+  while(argc > 0) {
+    arg1 = atom_getsymbolarg(0, argc, argv);
+    if(!strcmp(arg1->s_name, "-flush"))
+      lsl_publisher_flush_interval(x, atom_getfloatarg(1, argc, argv));
+    else if(!strcmp(arg1->s_name, "-latency"))
+      x->latency = atom_getfloatarg(1, argc, argv);
+    else{
+      pd_error(x, "lsl_publisher: %s: unknown flag or argument missing", arg1->s_name);
+      argc--, argv++;
+      continue;
+    }
+    argc-=2, argv+=2;
+  }
+
+  x->clk_anchor = clock_getlogicaltime();
+  x->clk_valid = 0;
+  // the mapping starts with the first push, liblsl isn't loaded before
+  x->sync_clock = clock_new(x, (t_method)lsl_publisher_sync);
+
+  x->report_clock = clock_new(x, (t_method)lsl_publisher_report);
+  clock_delay(x->report_clock, REPORT_INTERVAL);
+
+  pthread_mutex_init(&x->lock, NULL);
+  // the sender starts with the first stream
+  x->running = 0;
+  x->stop_ = 1;
+
+  return x;
+}
+
+void lsl_publisher_free(t_lsl_publisher *x){
+
+  t_pub_stream *st;
+  int i;
+
+  // with the sender gone nothing else touches the table
+  stop_sender(x);
+  for(i=0;i<HASHSIZE;i++)
+    while((st = x->table[i])!=NULL){
+      x->table[i] = st->next;
+      free_stream(x, st);
+    }
+  clock_free(x->sync_clock);
+  clock_free(x->report_clock);
+  pthread_mutex_destroy(&x->lock);
+}
+
+void lsl_publisher_setup(void){
+
+  lsl_publisher_class = class_new(gensym("lsl_publisher"),
+				  (t_newmethod)lsl_publisher_new,
+				  (t_method)lsl_publisher_free,
+				  sizeof(t_lsl_publisher),
+				  0,
+				  A_GIMME,
+				  0);
+
+  class_addmethod(lsl_publisher_class,
+		  (t_method)lsl_publisher_add,
+		  gensym("add"),
+		  A_GIMME,
+		  0);
+
+  class_addmethod(lsl_publisher_class,
+		  (t_method)lsl_publisher_remove,
+		  gensym("remove"),
+		  A_SYMBOL,
+		  0);
+
+  class_addmethod(lsl_publisher_class,
+		  (t_method)lsl_publisher_clear,
+		  gensym("clear"),
+		  0);
+
+  class_addmethod(lsl_publisher_class,
+		  (t_method)lsl_publisher_push,
+		  gensym("push"),
+		  A_GIMME,
+		  0);
+
+  class_addmethod(lsl_publisher_class,
+		  (t_method)lsl_publisher_list_streams,
+		  gensym("list_streams"),
+		  0);
+
+  class_addmethod(lsl_publisher_class,
+		  (t_method)lsl_publisher_flush_interval,
+		  gensym("flush_interval"),
+		  A_FLOAT,
+		  0);
+
+  class_addmethod(lsl_publisher_class,
+		  (t_method)lsl_publisher_latency,
+		  gensym("latency"),
+		  A_FLOAT,
+		  0);
+}
@@ -0,0 +1,34 @@
+/****************** pdlsl ******************/
+/* Written by David Medine on behalf of    */
+/* Brain Products                          */
+/* 15/5/2017                               */
+/* Released under the GPL                  */
+/* This software is free and open source   */
+/*******************************************/
+
+
+// All of the objects in one binary. Loaded with -lib pdlsl (or
+// [declare -lib pdlsl]) they share a single copy of everything in common/:
+// liblsl is opened once, there is one registry and one resolver for the
+// whole process and every query goes through the same workers.
+
+#include "m_pd.h"
+
+void lsl_inlet_setup(void);
+void lsl_inlet_tilde_setup(void);
+void lsl_outlet_setup(void);
+void lsl_outlet_tilde_setup(void);
+void lsl_publisher_setup(void);
+void lsl_monitor_setup(void);
+
+void pdlsl_setup(void){
+
+  lsl_inlet_setup();
+  lsl_inlet_tilde_setup();
+  lsl_outlet_setup();
+  lsl_outlet_tilde_setup();
+  lsl_publisher_setup();
+  lsl_monitor_setup();
+
+  post("pdlsl: lsl_inlet lsl_inlet~ lsl_outlet lsl_outlet~ lsl_publisher lsl_monitor");
+}